@@ -0,0 +1,20 @@
+#include "chainlog.h"
+
+namespace {
+ChainLogHook& hook() {
+    static ChainLogHook instance;
+    return instance;
+}
+}
+
+void SetChainLogHook(ChainLogHook newHook) {
+    hook() = std::move(newHook);
+}
+
+bool ChainLogEnabled() {
+    return static_cast<bool>(hook());
+}
+
+void ChainLog(ChainLogLevel level, const std::string& message) {
+    if (hook()) hook()(level, message);
+}
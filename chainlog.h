@@ -0,0 +1,48 @@
+#ifndef CHAINLOG_H
+#define CHAINLOG_H
+
+#include <functional>
+#include <sstream>
+#include <string>
+
+/**
+ * Logging hook of the share chain core.
+ * The core never prints by itself; the embedding program installs a hook
+ * (P2PoolNode routes it to the ns-3 "ShareChain" log component).
+ */
+enum class ChainLogLevel {
+    Error,
+    Warn,
+    Info,
+    Debug
+};
+
+using ChainLogHook = std::function<void(ChainLogLevel, const std::string&)>;
+
+/**
+ * Installs the hook receiving every core log message; an empty hook
+ * disables logging.
+ */
+void SetChainLogHook(ChainLogHook hook);
+
+/**
+ * Returns true if a hook is installed.
+ */
+bool ChainLogEnabled();
+
+/**
+ * Passes a message to the installed hook.
+ */
+void ChainLog(ChainLogLevel level, const std::string& message);
+
+// Formats the message only when a hook is installed.
+#define CHAIN_LOG(level, msg)                                                                \
+    do {                                                                                     \
+        if (ChainLogEnabled()) {                                                             \
+            std::ostringstream chainLogStream;                                               \
+            chainLogStream << msg;                                                           \
+            ChainLog(level, chainLogStream.str());                                           \
+        }                                                                                    \
+    } while (0)
+
+#endif
@@ -0,0 +1,157 @@
+#include "eventlog.h"
+
+#include <cstring>
+
+namespace {
+const char kMagic[8] = {'P', '2', 'P', 'L', 'O', 'G', '0', '2'};
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Reads a T at offset and advances it; false if the data is too short
+template <typename T>
+bool get(const std::string& data, size_t& offset, T& value) {
+    if (offset > data.size() || data.size() - offset < sizeof(T)) return false;
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+template <typename T>
+bool read(std::ifstream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <typename T>
+void write(std::ofstream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+}
+
+void encodeShare(const Share& share, std::string& out) {
+    put<ShareId>(out, share.getShareId());
+    put<uint32_t>(out, share.getSenderId());
+    put<int64_t>(out, share.getTimestamp().GetNanoSeconds());
+    put<ShareId>(out, share.getParentId());
+    put<double>(out, share.getDifficulty());
+    put<uint32_t>(out, share.getPrevRefs().size());
+    for (ShareId ref : share.getPrevRefs()) {
+        put<ShareId>(out, ref);
+    }
+}
+
+Share* decodeShare(const std::string& data) {
+    size_t offset = 0;
+    ShareId shareId, parentId;
+    uint32_t senderId, numRefs;
+    int64_t timestamp;
+    double difficulty;
+    if (!get(data, offset, shareId) || !get(data, offset, senderId) ||
+        !get(data, offset, timestamp) || !get(data, offset, parentId) ||
+        !get(data, offset, difficulty) || !get(data, offset, numRefs)) {
+        return nullptr;
+    }
+    if ((data.size() - offset) / sizeof(ShareId) < numRefs) return nullptr;
+    std::vector<ShareId> refs(numRefs);
+    for (ShareId& ref : refs) {
+        get(data, offset, ref);
+    }
+    return new Share(shareId, senderId, ShareTime::FromNanoSeconds(timestamp), refs, parentId,
+                     difficulty);
+}
+
+void encodeSummary(const ChainSummary& summary, std::string& out) {
+    put(out, summary.bestTip);
+    put(out, summary.totalShares);
+    put(out, summary.mainChainLength);
+    put(out, summary.uncleBlocks);
+    put(out, summary.pendingShares);
+}
+
+bool decodeSummary(const std::string& data, ChainSummary& summary) {
+    size_t offset = 0;
+    return get(data, offset, summary.bestTip) && get(data, offset, summary.totalShares) &&
+           get(data, offset, summary.mainChainLength) && get(data, offset, summary.uncleBlocks) &&
+           get(data, offset, summary.pendingShares);
+}
+
+EventLogWriter::EventLogWriter(const std::string& path, uint32_t numNodes, ShareTime maxTimestamp)
+    : out(path, std::ios::binary | std::ios::trunc), records(0) {
+    out.write(kMagic, sizeof(kMagic));
+    write<uint32_t>(out, numNodes);
+    write<int64_t>(out, maxTimestamp.GetNanoSeconds());
+}
+
+bool EventLogWriter::isOpen() const {
+    return out.is_open() && out.good();
+}
+
+void EventLogWriter::logArrival(ShareTime time, uint32_t node, const Share& share) {
+    std::lock_guard<std::mutex> guard(lock);
+    scratch.clear();
+    encodeShare(share, scratch);
+    writeRecord(EventType::Arrival, time, node, scratch);
+}
+
+void EventLogWriter::logSummary(ShareTime time, uint32_t node, const ChainSummary& summary) {
+    std::lock_guard<std::mutex> guard(lock);
+    scratch.clear();
+    encodeSummary(summary, scratch);
+    writeRecord(EventType::Summary, time, node, scratch);
+}
+
+void EventLogWriter::writeRecord(EventType type, ShareTime time, uint32_t node,
+                                 const std::string& payload) {
+    write<uint8_t>(out, static_cast<uint8_t>(type));
+    write<int64_t>(out, time.GetNanoSeconds());
+    write<uint32_t>(out, node);
+    write<uint32_t>(out, payload.size());
+    out.write(payload.data(), payload.size());
+    records++;
+}
+
+uint64_t EventLogWriter::getRecordCount() const {
+    return records;
+}
+
+void EventLogWriter::close() {
+    out.close();
+}
+
+EventLogReader::EventLogReader(const std::string& path)
+    : in(path, std::ios::binary), valid(false), numNodes(0) {
+    char magic[sizeof(kMagic)];
+    int64_t maxNanos;
+    if (in.read(magic, sizeof(magic)) && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0 &&
+        read(in, numNodes) && read(in, maxNanos)) {
+        maxTimestamp = ShareTime::FromNanoSeconds(maxNanos);
+        valid = true;
+    }
+}
+
+bool EventLogReader::isOpen() const {
+    return valid;
+}
+
+uint32_t EventLogReader::getNodeCount() const {
+    return numNodes;
+}
+
+ShareTime EventLogReader::getMaxTimestamp() const {
+    return maxTimestamp;
+}
+
+bool EventLogReader::next(EventRecord& record) {
+    uint8_t type;
+    int64_t time;
+    uint32_t size;
+    if (!valid || !read(in, type) || !read(in, time) || !read(in, record.node) || !read(in, size)) {
+        return false;
+    }
+    record.type = static_cast<EventType>(type);
+    record.time = ShareTime::FromNanoSeconds(time);
+    record.payload.resize(size);
+    return static_cast<bool>(in.read(&record.payload[0], size)) || size == 0;
+}
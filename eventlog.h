@@ -0,0 +1,124 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "share.h"
+#include "sharetime.h"
+
+/**
+ * Binary log of the shares handed to every node's ShareChain, in the order
+ * the chains saw them, so that chain experiments can be replayed offline
+ * (tools/replay) without the network simulation.
+ *
+ * File layout (host byte order):
+ *   header:  "P2PLOG02", uint32 node count, int64 max share timestamp (ns)
+ *   records: uint8 type, int64 time (ns), uint32 node, uint32 size, payload
+ *
+ * An Arrival record carries an encoded share. A Summary record, written
+ * once per node at the end of the run, carries the final chain state so
+ * that a replay can check it reproduces the run.
+ */
+enum class EventType : uint8_t {
+    Arrival = 0,
+    Summary = 1
+};
+
+/**
+ * Final chain state of one node.
+ */
+struct ChainSummary {
+    ShareId bestTip;
+    uint32_t totalShares;
+    uint32_t mainChainLength;
+    uint32_t uncleBlocks;
+    uint32_t pendingShares;
+};
+
+struct EventRecord {
+    EventType type;
+    ShareTime time;
+    uint32_t node;
+    std::string payload;
+};
+
+/**
+ * Appends the compact binary encoding of a share to out.
+ */
+void encodeShare(const Share& share, std::string& out);
+
+/**
+ * Decodes a share written by encodeShare, or returns null if the bytes are
+ * malformed. The caller owns the share.
+ */
+Share* decodeShare(const std::string& data);
+
+void encodeSummary(const ChainSummary& summary, std::string& out);
+bool decodeSummary(const std::string& data, ChainSummary& summary);
+
+/**
+ * Appends records to a log. Every record is written under a mutex, so
+ * nodes simulated on different threads can share one writer; each node's
+ * records keep their order, which is all tools/replay relies on.
+ */
+class EventLogWriter {
+public:
+    /**
+     * Creates the log file and writes its header; check isOpen().
+     */
+    EventLogWriter(const std::string& path, uint32_t numNodes, ShareTime maxTimestamp);
+
+    bool isOpen() const;
+
+    /**
+     * Records that share was handed to node's chain at time.
+     */
+    void logArrival(ShareTime time, uint32_t node, const Share& share);
+
+    /**
+     * Records a node's final chain state.
+     */
+    void logSummary(ShareTime time, uint32_t node, const ChainSummary& summary);
+
+    uint64_t getRecordCount() const;
+
+    void close();
+
+private:
+    void writeRecord(EventType type, ShareTime time, uint32_t node, const std::string& payload);
+
+    std::ofstream out;
+    std::string scratch;
+    uint64_t records;
+    std::mutex lock;
+};
+
+class EventLogReader {
+public:
+    /**
+     * Opens a log and reads its header; check isOpen().
+     */
+    explicit EventLogReader(const std::string& path);
+
+    bool isOpen() const;
+    uint32_t getNodeCount() const;
+    ShareTime getMaxTimestamp() const;
+
+    /**
+     * Reads the next record.
+     * @return false at the end of the log or on a truncated record
+     */
+    bool next(EventRecord& record);
+
+private:
+    std::ifstream in;
+    bool valid;
+    uint32_t numNodes;
+    ShareTime maxTimestamp;
+};
+
+#endif
@@ -0,0 +1,210 @@
+#include "linkmonitor.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+using namespace ns3;
+
+FractionHistogram::FractionHistogram() : samples(0), sum(0) {
+    bins.fill(0);
+}
+
+void FractionHistogram::add(double fraction) {
+    fraction = std::min(std::max(fraction, 0.0), 1.0);
+    bins[std::min(kBins - 1, static_cast<size_t>(fraction * kBins))]++;
+    samples++;
+    sum += fraction;
+}
+
+void FractionHistogram::merge(const FractionHistogram& other) {
+    for (size_t i = 0; i < kBins; ++i) {
+        bins[i] += other.bins[i];
+    }
+    samples += other.samples;
+    sum += other.sum;
+}
+
+double FractionHistogram::quantile(double q) const {
+    if (samples == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * (samples - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBins; ++i) {
+        seen += bins[i];
+        if (seen > rank) return static_cast<double>(i + 1) / kBins;
+    }
+    return 1.0;
+}
+
+uint64_t FractionHistogram::count() const {
+    return samples;
+}
+
+double FractionHistogram::mean() const {
+    return samples ? sum / samples : 0;
+}
+
+namespace {
+// Fraction of a queue's limit in use, in the limit's unit
+double fillLevel(QueueSize maxSize, uint32_t packets, uint32_t bytes) {
+    double used = maxSize.GetUnit() == QueueSizeUnit::PACKETS ? packets : bytes;
+    return maxSize.GetValue() ? used / maxSize.GetValue() : 0;
+}
+}
+
+LinkMonitor::LinkMonitor(Time interval, Time stop) : interval(interval), stop(stop) {}
+
+void LinkMonitor::AddDirection(uint32_t node, uint32_t peer, Ptr<NetDevice> device) {
+    Ptr<PointToPointNetDevice> p2pDevice = DynamicCast<PointToPointNetDevice>(device);
+    if (!p2pDevice) return;
+
+    auto direction = std::make_unique<Direction>();
+    direction->node = node;
+    direction->peer = peer;
+    direction->device = p2pDevice;
+    direction->queue = p2pDevice->GetQueue();
+    DataRateValue rate;
+    p2pDevice->GetAttribute("DataRate", rate);
+    direction->bitRate = rate.Get().GetBitRate();
+    direction->bytes = 0;
+    direction->packets = 0;
+    direction->drops = 0;
+    direction->sampledBytes = 0;
+
+    p2pDevice->TraceConnectWithoutContext(
+        "PhyTxEnd", MakeBoundCallback(&LinkMonitor::OnTransmit, direction.get()));
+    p2pDevice->TraceConnectWithoutContext(
+        "MacTxDrop", MakeBoundCallback(&LinkMonitor::OnDrop, direction.get()));
+    Ptr<TrafficControlLayer> trafficControl = device->GetNode()->GetObject<TrafficControlLayer>();
+    if (trafficControl) {
+        direction->queueDisc = trafficControl->GetRootQueueDiscOnDevice(device);
+    }
+    if (direction->queueDisc) {
+        direction->queueDisc->TraceConnectWithoutContext(
+            "Drop", MakeBoundCallback(&LinkMonitor::OnQueueDiscDrop, direction.get()));
+    }
+    directions.push_back(std::move(direction));
+}
+
+void LinkMonitor::OnTransmit(Direction* direction, Ptr<const Packet> packet) {
+    direction->bytes += packet->GetSize();
+    direction->packets++;
+}
+
+void LinkMonitor::OnDrop(Direction* direction, Ptr<const Packet>) {
+    direction->drops++;
+}
+
+void LinkMonitor::OnQueueDiscDrop(Direction* direction, Ptr<const QueueDiscItem>) {
+    direction->drops++;
+}
+
+void LinkMonitor::Start() {
+    if (interval.IsStrictlyPositive()) {
+        Simulator::Schedule(interval, &LinkMonitor::Sample, this);
+    }
+}
+
+void LinkMonitor::Sample() {
+    double seconds = interval.GetSeconds();
+    for (auto& direction : directions) {
+        uint64_t sent = direction->bytes - direction->sampledBytes;
+        direction->sampledBytes = direction->bytes;
+        if (direction->bitRate > 0) {
+            direction->utilization.add(sent * 8.0 / (direction->bitRate * seconds));
+        }
+        if (direction->queue || direction->queueDisc) {
+            double fill = 0;
+            if (direction->queue) {
+                fill = fillLevel(direction->queue->GetMaxSize(), direction->queue->GetNPackets(),
+                                 direction->queue->GetNBytes());
+            }
+            if (direction->queueDisc) {
+                fill = std::max(fill, fillLevel(direction->queueDisc->GetMaxSize(),
+                                                direction->queueDisc->GetNPackets(),
+                                                direction->queueDisc->GetNBytes()));
+            }
+            direction->queueFill.add(fill);
+        }
+    }
+    if (Simulator::Now() + interval <= stop) {
+        Simulator::Schedule(interval, &LinkMonitor::Sample, this);
+    }
+}
+
+void LinkMonitor::PrintReport(std::ostream& os, uint32_t numNodes) const {
+    if (directions.empty()) return;
+    FractionHistogram utilization;
+    FractionHistogram queueFill;
+    uint64_t drops = 0;
+    uint32_t droppingDirections = 0;
+    std::vector<FractionHistogram> nodeUtilization(numNodes);
+    std::vector<FractionHistogram> nodeQueueFill(numNodes);
+    std::vector<uint64_t> nodeDrops(numNodes, 0);
+    for (const auto& direction : directions) {
+        utilization.merge(direction->utilization);
+        queueFill.merge(direction->queueFill);
+        drops += direction->drops;
+        droppingDirections += direction->drops > 0;
+        nodeUtilization[direction->node].merge(direction->utilization);
+        nodeQueueFill[direction->node].merge(direction->queueFill);
+        nodeDrops[direction->node] += direction->drops;
+    }
+
+    auto percent = [](double fraction) { return fraction * 100; };
+    os << "=== Link utilization ===" << std::endl;
+    os << "Directions monitored: " << directions.size() << ", sampled every "
+       << interval.GetSeconds() << "s (percentiles have 5% resolution)" << std::endl;
+    os << "  " << std::left << std::setw(14) << "(% of link)" << std::right << std::setw(8) << "p50"
+       << std::setw(8) << "p90" << std::setw(8) << "p99" << std::setw(8) << "mean" << std::endl;
+    auto row = [&](const char* name, const FractionHistogram& histogram) {
+        os << "  " << std::left << std::setw(14) << name << std::right << std::fixed
+           << std::setprecision(1) << std::setw(8) << percent(histogram.quantile(0.5))
+           << std::setw(8) << percent(histogram.quantile(0.9)) << std::setw(8)
+           << percent(histogram.quantile(0.99)) << std::setw(8) << percent(histogram.mean())
+           << std::endl << std::defaultfloat;
+    };
+    row("utilization", utilization);
+    row("queue fill", queueFill);
+    os << "Drops: " << drops << " packets on " << droppingDirections << " directions" << std::endl;
+
+    std::vector<const Direction*> busiest;
+    for (const auto& direction : directions) {
+        busiest.push_back(direction.get());
+    }
+    size_t shown = std::min<size_t>(5, busiest.size());
+    std::partial_sort(busiest.begin(), busiest.begin() + shown, busiest.end(),
+                      [](const Direction* a, const Direction* b) { return a->bytes > b->bytes; });
+    os << "Busiest directions:" << std::endl;
+    for (size_t i = 0; i < shown; ++i) {
+        const Direction* direction = busiest[i];
+        os << "  " << direction->node << " -> " << direction->peer << ": " << direction->bytes
+           << " bytes, " << direction->packets << " packets, utilization p99 "
+           << percent(direction->utilization.quantile(0.99)) << "%, queue p99 "
+           << percent(direction->queueFill.quantile(0.99)) << "%, drops " << direction->drops
+           << std::endl;
+    }
+
+    os << "Outgoing utilization per node:" << std::endl;
+    for (uint32_t i = 0; i < numNodes; ++i) {
+        if (nodeUtilization[i].count() == 0) continue;
+        os << "  Node " << i << ": p50 " << percent(nodeUtilization[i].quantile(0.5)) << "%, p99 "
+           << percent(nodeUtilization[i].quantile(0.99)) << "%, queue p99 "
+           << percent(nodeQueueFill[i].quantile(0.99)) << "%, drops " << nodeDrops[i] << std::endl;
+    }
+}
+
+bool LinkMonitor::WriteCsv(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out.is_open()) return false;
+    out << "node,peer,bytes,packets,drops,util_p50,util_p90,util_p99,util_mean,queue_p50,queue_p99"
+        << std::endl;
+    for (const auto& direction : directions) {
+        out << direction->node << ',' << direction->peer << ',' << direction->bytes << ','
+            << direction->packets << ',' << direction->drops << ','
+            << direction->utilization.quantile(0.5) << ',' << direction->utilization.quantile(0.9)
+            << ',' << direction->utilization.quantile(0.99) << ',' << direction->utilization.mean()
+            << ',' << direction->queueFill.quantile(0.5) << ','
+            << direction->queueFill.quantile(0.99) << '\n';
+    }
+    return static_cast<bool>(out);
+}
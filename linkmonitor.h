@@ -0,0 +1,113 @@
+#ifndef LINKMONITOR_H
+#define LINKMONITOR_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ns3/network-module.h"
+#include "ns3/nstime.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+
+/**
+ * Fixed-size histogram of fractions in [0, 1] with 5% wide bins.
+ * Small enough to keep one per link direction in large topologies.
+ */
+class FractionHistogram {
+public:
+    static const size_t kBins = 20;
+
+    FractionHistogram();
+
+    void add(double fraction);
+    void merge(const FractionHistogram& other);
+
+    /**
+     * Returns the upper edge of the bin holding the q-quantile, or 0 if empty.
+     */
+    double quantile(double q) const;
+
+    uint64_t count() const;
+    double mean() const;
+
+private:
+    std::array<uint32_t, kBins> bins;
+    uint64_t samples;
+    double sum;
+};
+
+/**
+ * Per-direction traffic counters of the point-to-point mesh.
+ *
+ * Transmitted bytes and packets, and dropped packets, are counted from the
+ * device trace sources with one bound callback per direction, so the per
+ * packet cost is a counter increment. Drops also include those of the
+ * device's root queue disc (installed by default with the IPv4 addresses),
+ * where overflow happens once its flow control stops the device queue.
+ * Every sampling interval the monitor turns the bytes sent since the last
+ * sample into a utilization of the link's data rate and reads the fill
+ * level of the fuller of the device queue and the queue disc; both go into
+ * fixed-size histograms. The sampling interval bounds the overhead.
+ */
+class LinkMonitor {
+public:
+    /**
+     * @param interval sampling period of utilization and queue occupancy
+     * @param stop last sampling time
+     */
+    LinkMonitor(ns3::Time interval, ns3::Time stop);
+
+    /**
+     * Monitors the transmit side of device, which sends from node to peer.
+     */
+    void AddDirection(uint32_t node, uint32_t peer, ns3::Ptr<ns3::NetDevice> device);
+
+    /**
+     * Schedules the first sample.
+     */
+    void Start();
+
+    /**
+     * Prints utilization and queue percentiles over all links, the busiest
+     * links, and the outgoing utilization of every node.
+     */
+    void PrintReport(std::ostream& os, uint32_t numNodes) const;
+
+    /**
+     * Writes one CSV row of counters and percentiles per direction.
+     */
+    bool WriteCsv(const std::string& path) const;
+
+private:
+    struct Direction {
+        uint32_t node;
+        uint32_t peer;
+        ns3::Ptr<ns3::PointToPointNetDevice> device;
+        ns3::Ptr<ns3::Queue<ns3::Packet>> queue;
+        // null if the device has no traffic control
+        ns3::Ptr<ns3::QueueDisc> queueDisc;
+        double bitRate;
+        uint64_t bytes;
+        uint64_t packets;
+        uint64_t drops;
+        uint64_t sampledBytes;
+        FractionHistogram utilization;
+        FractionHistogram queueFill;
+    };
+
+    static void OnTransmit(Direction* direction, ns3::Ptr<const ns3::Packet> packet);
+    static void OnDrop(Direction* direction, ns3::Ptr<const ns3::Packet>);
+    static void OnQueueDiscDrop(Direction* direction, ns3::Ptr<const ns3::QueueDiscItem>);
+
+    void Sample();
+
+    ns3::Time interval;
+    ns3::Time stop;
+    // unique_ptr keeps the addresses bound into the callbacks stable
+    std::vector<std::unique_ptr<Direction>> directions;
+};
+
+#endif
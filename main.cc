@@ -5,9 +5,18 @@
 #include "ns3/applications-module.h"
 #include "ns3/config-store-module.h"
 
+#ifdef NS3_MPI
+#include "ns3/mpi-interface.h"
+#endif
+
+#ifdef NS3_MTP
+#include "ns3/mtp-interface.h"
+#endif
+
 #include <iostream>
 #include <string>
 #include "p2pmanager.h"  
+#include "profiler.h"
 
 using namespace ns3;
 
@@ -18,12 +27,153 @@ int main(int argc, char *argv[]) {
   uint32_t maxTipsToReference = 10000; 
   uint32_t simDuration = 500;   
   double latency = 50;   
+  bool nullmsg = false;
+  uint32_t threads = 0;
+  bool verbose = true;
+  std::string arrivalModel = "normal";
+  std::string hashPower = "legacy";
+  double paretoShape = 1.5;
+  std::string profileJson;
+  double sampleInterval = 0;
+  std::string timeSeriesFile = "output/timeseries.csv";
+  uint32_t retargetWindow = 0;
+  double targetInterval = 0;
+  uint32_t pplnsWindow = 0;
+  double uncleWeight = 1.0;
+  uint32_t lateJoiners = 0;
+  double joinTime = 60;
+  uint32_t syncBatchSize = 500;
+  double rewireInterval = 0;
+  uint32_t maxPeers = 8;
+  std::string strategies;
+  double releaseDelay = 5;
+  double templatePushDelay = 0;
+  double templateRefresh = 0;
+  std::string churnFile;
+  double churnRate = 0;
+  double churnDowntime = 30;
+  double convergenceInterval = 0.1;
+  double agreementInterval = 0;
+  std::string agreementFile = "output/agreement.csv";
+  std::string eventLog;
+  std::string linkRate = "5Mbps";
+  std::string regions = "none";
+  double regionJitter = 10;
+  std::string uplink = "fixed";
+  double uplinkMedian = 20;
+  double uplinkSigma = 0.8;
+  double linkSampleInterval = 0;
+  double propagationExpiry = 60;
+  std::string linkReportFile = "output/links.csv";
+  std::string snapshot;
+  std::string snapshotOut;
+  std::string dagExport;
+  uint32_t dagExportMinHeight = 0;
+  uint32_t dagExportMaxHeight = 0;
+  double validationCost = 0;
+  double validationCostPerRef = 0;
+  uint32_t validationWorkers = 1;
+  bool validationPriority = false;
+
+  CommandLine cmd(__FILE__);
+  cmd.AddValue("numNodes", "Number of mining nodes", numNodes);
+  cmd.AddValue("latency", "Link latency in milliseconds", latency);
+  cmd.AddValue("shareGenMean", "Mean share generation time in seconds", shareGenMean);
+  cmd.AddValue("shareGenVariance", "Variance of the share generation time", shareGenVariance);
+  cmd.AddValue("maxTipsToReference", "Maximum tips a share references", maxTipsToReference);
+  cmd.AddValue("simDuration", "Simulation duration in seconds", simDuration);
+  cmd.AddValue("arrivalModel", "Share arrivals: normal, exponential or superposed", arrivalModel);
+  cmd.AddValue("hashPower", "Hash power distribution: legacy, uniform, pareto or file:<path>", hashPower);
+  cmd.AddValue("paretoShape", "Shape of the Pareto hash power distribution", paretoShape);
+  cmd.AddValue("verbose", "Enable INFO logging (turn off for performance runs)", verbose);
+  cmd.AddValue("nullmsg", "Use the null-message distributed scheduler (MPI runs only)", nullmsg);
+  cmd.AddValue("threads", "Worker threads of the multithreaded simulator (NS3_MTP builds, 0 = sequential)", threads);
+  cmd.AddValue("linkRate", "Data rate of every point-to-point link", linkRate);
+  cmd.AddValue("regions", "Node regions: none, world or file:<path> (name, weight, RTTs in ms)", regions);
+  cmd.AddValue("regionJitter", "Largest extra one-way delay of a link in milliseconds", regionJitter);
+  cmd.AddValue("uplink", "Node uplink distribution: fixed (= linkRate), lognormal or file:<path>", uplink);
+  cmd.AddValue("uplinkMedian", "Median uplink of the lognormal distribution in Mbps", uplinkMedian);
+  cmd.AddValue("uplinkSigma", "Standard deviation of the log of the uplink", uplinkSigma);
+  cmd.AddValue("propagationExpiry", "Seconds a share is tracked before it counts as incomplete", propagationExpiry);
+  cmd.AddValue("linkSampleInterval", "Link utilization and queue sampling period in seconds (0 disables)", linkSampleInterval);
+  cmd.AddValue("linkReportFile", "Output file of the per-link counters", linkReportFile);
+  cmd.AddValue("eventLog", "Record share arrivals to this binary log for tools/replay", eventLog);
+  cmd.AddValue("snapshot", "Preload every node's chain from this ShareChain snapshot", snapshot);
+  cmd.AddValue("snapshotOut", "Write node 0's chain to this snapshot at the end of the run", snapshotOut);
+  cmd.AddValue("dagExport", "Write node 0's DAG to this file at the end (.dot = Graphviz, else a share table)", dagExport);
+  cmd.AddValue("dagExportMinHeight", "Lowest height exported (0 = genesis)", dagExportMinHeight);
+  cmd.AddValue("dagExportMaxHeight", "Highest height exported (0 = up to the tips)", dagExportMaxHeight);
+  cmd.AddValue("profileJson", "Write the hot-path profile to this JSON file", profileJson);
+  cmd.AddValue("sampleInterval", "Chain time-series sampling period in seconds (0 disables)", sampleInterval);
+  cmd.AddValue("timeSeriesFile", "Output file of the chain time series", timeSeriesFile);
+  cmd.AddValue("retargetWindow", "Main-chain shares the difficulty retarget averages over (0 disables)", retargetWindow);
+  cmd.AddValue("targetInterval", "Target share interval in seconds (0 = shareGenMean)", targetInterval);
+  cmd.AddValue("pplnsWindow", "Main-chain shares in the PPLNS payout window (0 disables)", pplnsWindow);
+  cmd.AddValue("uncleWeight", "Fraction of its difficulty an uncle share is paid", uncleWeight);
+  cmd.AddValue("lateJoiners", "Number of nodes that join late and sync the chain", lateJoiners);
+  cmd.AddValue("joinTime", "Time the late nodes join in seconds", joinTime);
+  cmd.AddValue("syncBatchSize", "Shares per sync message", syncBatchSize);
+  cmd.AddValue("rewireInterval", "Peer scoring round in seconds; the worst peer is replaced each round (0 disables)", rewireInterval);
+  cmd.AddValue("maxPeers", "Most peers a rewiring node keeps", maxPeers);
+  cmd.AddValue("strategies", "Strategic miners as <node>:<honest|selfish|delay>,...", strategies);
+  cmd.AddValue("releaseDelay", "Time a delay miner holds each share in seconds", releaseDelay);
+  cmd.AddValue("templatePushDelay", "Delay from a best-tip change to new mining work in milliseconds", templatePushDelay);
+  cmd.AddValue("templateRefresh", "Mining work refresh period in seconds (0 disables)", templateRefresh);
+  cmd.AddValue("churnFile", "Scenario file with leave/join/linkdown/linkup/partition/heal events", churnFile);
+  cmd.AddValue("churnRate", "Random node departures per second (0 disables)", churnRate);
+  cmd.AddValue("churnDowntime", "Mean offline time of a departed node in seconds", churnDowntime);
+  cmd.AddValue("validationCost", "Fixed validation cost of a received share in milliseconds", validationCost);
+  cmd.AddValue("validationCostPerRef", "Validation cost per share reference in milliseconds", validationCostPerRef);
+  cmd.AddValue("validationWorkers", "Shares a node validates in parallel", validationWorkers);
+  cmd.AddValue("validationPriority", "Validate shares building on the best tip first", validationPriority);
+  cmd.AddValue("agreementInterval", "Main-chain agreement sampling period in seconds (0 disables)", agreementInterval);
+  cmd.AddValue("agreementFile", "Output file of the main-chain agreement samples", agreementFile);
+  cmd.AddValue("convergenceInterval", "Best-tip agreement check period in seconds after disruptions (0 disables)", convergenceInterval);
+  cmd.Parse(argc, argv);
+
+#ifdef NS3_MPI
+  // The distributed simulator has to be selected before any node exists,
+  // and before MpiInterface::Enable, which picks the communication
+  // interface matching it. With a single rank the default sequential
+  // scheduler is restored.
+  GlobalValue::Bind("SimulatorImplementationType",
+                    StringValue(nullmsg ? "ns3::NullMessageSimulatorImpl"
+                                        : "ns3::DistributedSimulatorImpl"));
+  MpiInterface::Enable(&argc, &argv);
+  if (MpiInterface::GetSize() == 1)
+  {
+    MpiInterface::Disable();
+    GlobalValue::Bind("SimulatorImplementationType", StringValue("ns3::DefaultSimulatorImpl"));
+  }
+#endif
+
+#ifdef NS3_MTP
+  // The multithreaded simulator is selected the same way; it partitions
+  // the nodes at their point-to-point links, whose delays bound each
+  // parallel round.
+  if (threads > 1)
+  {
+#ifdef NS3_MPI
+    NS_ABORT_MSG_IF(MpiInterface::IsEnabled(), "--threads cannot be combined with MPI ranks");
+#endif
+    MtpInterface::Enable(threads);
+  }
+#else
+  if (threads > 1)
+  {
+    std::cerr << "--threads needs an NS3_MTP build; running sequentially" << std::endl;
+  }
+#endif
+
   Time maxTimeStamp=Seconds(simDuration/10); 
 
 
-  LogComponentEnable("P2PManager", LOG_LEVEL_INFO);
-  LogComponentEnable("ShareChain", LOG_LEVEL_INFO);
-  LogComponentEnable("Node", LOG_LEVEL_INFO);
+  if (verbose)
+  {
+    LogComponentEnable("P2PManager", LOG_LEVEL_INFO);
+    LogComponentEnable("ShareChain", LOG_LEVEL_INFO);
+    LogComponentEnable("P2PoolNode", LOG_LEVEL_INFO);
+  }
 
 
   std::cout << "=== P2Pool Simulation Parameters ===" << std::endl;
@@ -41,13 +191,68 @@ int main(int argc, char *argv[]) {
                         shareGenMean, shareGenVariance, 
                         maxTipsToReference, simDuration, maxTimeStamp);
   
+  p2pManager.ConfigureMining(arrivalModel, hashPower, paretoShape);
+  p2pManager.SetDifficultyRetarget(retargetWindow, targetInterval > 0 ? targetInterval : shareGenMean);
+  p2pManager.SetPayoutWindow(pplnsWindow, uncleWeight);
+  p2pManager.SetPropagationExpiry(Seconds(propagationExpiry));
+  p2pManager.SetValidationCost(Seconds(validationCost / 1000), Seconds(validationCostPerRef / 1000),
+                               validationWorkers, validationPriority);
+  p2pManager.SetLateJoiners(lateJoiners, Seconds(joinTime), syncBatchSize);
+  p2pManager.SetMinerStrategies(strategies, Seconds(releaseDelay));
+  p2pManager.SetWorkTemplate(MilliSeconds(templatePushDelay), Seconds(templateRefresh));
+  p2pManager.SetLinkDataRate(linkRate);
+  p2pManager.SetRegions(regions, regionJitter);
+  p2pManager.SetAccessBandwidth(uplink, uplinkMedian, uplinkSigma);
   p2pManager.CreateRandomTopology( 0.3,latency);
+  p2pManager.EnablePeerRewiring(Seconds(rewireInterval), maxPeers);
+  p2pManager.EnableLinkMonitoring(Seconds(linkSampleInterval), linkReportFile);
+  if (convergenceInterval > 0)
+  {
+    p2pManager.EnableConvergenceTracking(Seconds(convergenceInterval));
+  }
+  p2pManager.EnableAgreementSampling(Seconds(agreementInterval), agreementFile);
+  if (!churnFile.empty())
+  {
+    p2pManager.LoadChurnScenario(churnFile);
+  }
+  if (!snapshot.empty())
+  {
+    // preloaded shares are not in the log, so a replay could not rebuild the chains
+    NS_ABORT_MSG_IF(!eventLog.empty(), "--eventLog cannot be combined with --snapshot");
+    p2pManager.LoadSnapshot(snapshot);
+  }
+  if (!snapshotOut.empty())
+  {
+    p2pManager.SaveSnapshotOnExit(snapshotOut);
+  }
+  if (!dagExport.empty())
+  {
+    p2pManager.ExportDagOnExit(dagExport, dagExportMinHeight, dagExportMaxHeight);
+  }
+  p2pManager.EnableRandomChurn(churnRate, churnDowntime);
+  p2pManager.EnableTimeSeries(Seconds(sampleInterval), timeSeriesFile);
+  if (!eventLog.empty())
+  {
+    p2pManager.EnableEventLog(eventLog);
+  }
   
 
   std::cout << "Starting simulation..." << std::endl;
   p2pManager.Run();
   
   p2pManager.PrintResults();
+
+  if (!profileJson.empty() && !Profiler::WriteJson(profileJson))
+  {
+    std::cerr << "Failed to write profile to " << profileJson << std::endl;
+  }
+
+#ifdef NS3_MPI
+  if (MpiInterface::IsEnabled())
+  {
+    MpiInterface::Disable();
+  }
+#endif
   
   return 0;
 }
@@ -1,5 +1,7 @@
 #include "node.h"
 
+#include "profiler.h"
+
 #include "ns3/applications-module.h"
 #include "ns3/core-module.h"
 #include "ns3/internet-module.h"
@@ -15,6 +17,7 @@
 #include <algorithm>
 #include <ctime>
 #include <functional>
+#include <iomanip>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -27,20 +30,53 @@ using namespace ns3;
 NS_LOG_COMPONENT_DEFINE("P2PoolNode");
 
 P2PoolNode::P2PoolNode(uint32_t nodeId,
-                       Ptr<NormalRandomVariable> shareGenTimeModel,
+                       Ptr<RandomVariableStream> shareGenTimeModel,
                        uint32_t maxTipsToReference,
-                       ns3::Time max_share_time)
+                       ns3::Time max_share_time,
+                       double minShareInterval)
     : nodeId(nodeId),
-      shareChain(new ShareChain(max_share_time)),
+      shareChain(new ShareChain(ToShareTime(max_share_time))),
       maxTipsToReference(maxTipsToReference),
       shareGenTimeModel(shareGenTimeModel),
+      minShareInterval(minShareInterval),
+      syncRequested(false),
+      syncBatchSize(500),
+      syncExpected(0),
+      syncTarget(0),
+      syncedShares(0),
+      validationWorkers(1),
+      busyWorkers(0),
+      validationPriority(false),
+      maxQueueLength(0),
+      minerStrategy(HONEST_MINER),
+      maxDegree(0),
+      peersDropped(0),
+      peersDialled(0),
+      online(true),
       running(false),
       sharesCreated(0),
+      shareSequence(0),
       sharesReceived(0),
       sharesSent(0),
-      maxTime(max_share_time)
+      maxTime(max_share_time),
+      propagationTracker(nullptr),
+      eventLog(nullptr)
 {
-    LogComponentEnable("P2PoolNode", LOG_LEVEL_INFO);
+    ShareChain::Listener listener;
+    listener.onPending = [this](const Share* share) { sharePendingTrace(share); };
+    listener.onConnected = [this](const Share* share) {
+        shareConnectedTrace(share);
+        if (!withheldShares.empty() && share->getSenderId() != this->nodeId)
+        {
+            ReleaseWithheldShares(shareChain->getShareHeight(share->getShareId()));
+        }
+    };
+    listener.onBestTipChanged = [this](ShareId oldTip, ShareId newTip) {
+        bestTipChangedTrace(oldTip, newTip);
+        CheckCaughtUp();
+        ScheduleTemplatePush();
+    };
+    shareChain->setListener(listener);
 }
 
 P2PoolNode::~P2PoolNode()
@@ -66,16 +102,35 @@ void P2PoolNode::StartApplication(void)
         socket->SetAcceptCallback(MakeCallback(&P2PoolNode::ConnectionRequestCallback, this),
                                     MakeCallback(&P2PoolNode::ConnectionAcceptedCallback, this));
     }
+    if (templatePushDelay.IsStrictlyPositive() || templateRefreshInterval.IsStrictlyPositive())
+    {
+        // the chain may have been preloaded since the node was configured
+        workTemplate = CreateWorkTemplate();
+        if (templateRefreshInterval.IsStrictlyPositive())
+        {
+            templateRefreshEvent = Simulator::Schedule(templateRefreshInterval,
+                                                       &P2PoolNode::RefreshWorkTemplate,
+                                                       this);
+        }
+    }
 }
 
 void P2PoolNode::StopApplication(void)
 {
     running = false;
+    recvBuffers.clear();
+    sendBuffers.clear();
 
     if (nextShareEvent.IsRunning())
     {
         Simulator::Cancel(nextShareEvent);
     }
+    if (rewireEvent.IsRunning())
+    {
+        Simulator::Cancel(rewireEvent);
+    }
+    Simulator::Cancel(templatePushEvent);
+    Simulator::Cancel(templateRefreshEvent);
 
     if (socket)
     {
@@ -114,6 +169,21 @@ uint32_t P2PoolNode::getOrphanCount() const
     return shareChain->getOrphanCount();
 }
 
+uint32_t P2PoolNode::GetSharesCreated() const
+{
+    return sharesCreated;
+}
+
+uint32_t P2PoolNode::GetSharesReceived() const
+{
+    return sharesReceived;
+}
+
+uint32_t P2PoolNode::GetSharesSent() const
+{
+    return sharesSent;
+}
+
 void P2PoolNode::PrintChainStats() const
 {
 
@@ -125,86 +195,247 @@ void P2PoolNode::PrintChainStats() const
     std::cout << "  - Total Shares: " << shareChain->getTotalShares() << std::endl;
     std::cout << "  - Uncle BLocks " << shareChain->getUncleBlocks() << std::endl;
     std::cout << "  - MAin chainlen: " << shareChain->MainChainLength() << std::endl;
-    std::vector<uint32_t> a = shareChain->showchain();
+    std::cout << "  - Next share difficulty: " << shareChain->getNextShareDifficulty() << std::endl;
+    std::cout << "  - Main chain share interval: " << shareChain->getWindowInterval() << "s" << std::endl;
+    if (queueDelays.count() > 0)
+    {
+        std::cout << "  - Validation queue delay: mean " << queueDelays.mean() * 1000 << "ms, p99 "
+                  << queueDelays.quantile(0.99) * 1000 << "ms, max queue " << maxQueueLength
+                  << std::endl;
+    }
+    std::vector<ShareId> a = shareChain->showchain();
     for(int i=0;i<a.size();i++){
         std::cout<<a[i]<<' ';
     }
     std::cout<<std::endl;
 }
 
-void P2PoolNode::GenerateAndBroadcastShare()
+void P2PoolNode::GenerateAndBroadcastShare(double difficulty)
 {
     NS_LOG_FUNCTION("hey am i beinge generated is the issue oot ere debugging");
 
-    std::unordered_map<uint32_t, uint32_t> tips = shareChain->getChainTips();
-    std::vector<std::pair<uint32_t, int>> sortedtips(tips.begin(), tips.end());
-    std::vector<uint32_t> tipShares;
-    
-    std::sort(sortedtips.begin(), sortedtips.end(), [](const auto& a, const auto& b) {
-        return a.second > b.second;
-    });
-    uint32_t noOfTips = std::min(static_cast<uint32_t>(tips.size()), maxTipsToReference);
-    for (int i = 0; i < noOfTips; i++)
-    {
-        tipShares.push_back(sortedtips[i].first);
-    }
+    bool templated =
+        templatePushDelay.IsStrictlyPositive() || templateRefreshInterval.IsStrictlyPositive();
+    WorkTemplate work = templated ? workTemplate : CreateWorkTemplate();
+    const std::vector<ShareId>& tipShares = work.refs;
     ns3::Time now = Simulator::Now();
     ns3::Time nowInSeconds = Seconds(now.GetSeconds());
-    uint32_t uniqueshareid = GenerateUniqueShareId();
+    ShareId uniqueshareid = GenerateUniqueShareId();
+    if (templated)
+    {
+        // the best chain has already grown past the parent we are mining on
+        if (shareChain->getShareHeight(shareChain->getBestTip()) >
+            shareChain->getShareHeight(work.parent))
+        {
+            staleWorkShares.push_back(uniqueshareid);
+        }
+        templateAgeSum += now - work.built;
+    }
     
+    {
+    P2POOL_PROFILE_SCOPE("P2PoolNode share CSV I/O");
     int dir_status = system("mkdir -p output");
     std::string filename = "output/node_" + std::to_string(nodeId) + "_shares.csv";
     std::ofstream outFile(filename.c_str(), std::ios::app);
     if (outFile.is_open()) {
-        outFile << uniqueshareid << "," << nowInSeconds.GetSeconds() <<','<< tipShares.size()<<", "<<sortedtips[0].first<<std::endl;
+        outFile << uniqueshareid << "," << nowInSeconds.GetSeconds() <<','<< tipShares.size()<<", "<<work.parent<<std::endl;
         outFile.flush();  
         outFile.close();
     } else {
         NS_LOG_ERROR("Node " << nodeId << " failed to open file " << filename);
     }
+    }
 
-    Share* newShare = new Share(uniqueshareid, nodeId, nowInSeconds, tipShares,sortedtips[0].first);
+    Share* newShare = new Share(uniqueshareid, nodeId, ToShareTime(nowInSeconds), tipShares, work.parent,
+                                difficulty);
+    shareGeneratedTrace(newShare);
 
+    LogArrival(newShare);
     shareChain->addShare(newShare);
     sharesCreated++;
-    BroadcastShare(newShare);
+    if (propagationTracker)
+    {
+        propagationTracker->RecordGenerated(uniqueshareid, nodeId, Simulator::Now());
+    }
+    PublishOwnShare(newShare);
     ScheduleNextShareGeneration();
 }
 
-uint32_t P2PoolNode::GenerateUniqueShareId()
+P2PoolNode::WorkTemplate P2PoolNode::CreateWorkTemplate() const
+{
+    std::unordered_map<ShareId, uint32_t> tips = shareChain->getChainTips();
+    std::vector<std::pair<ShareId, int>> sortedtips(tips.begin(), tips.end());
+    std::sort(sortedtips.begin(), sortedtips.end(), [](const auto& a, const auto& b) {
+        return a.second > b.second;
+    });
+
+    WorkTemplate work;
+    uint32_t noOfTips = std::min(static_cast<uint32_t>(tips.size()), maxTipsToReference);
+    for (uint32_t i = 0; i < noOfTips; i++)
+    {
+        work.refs.push_back(sortedtips[i].first);
+    }
+    work.parent = sortedtips[0].first;
+    work.difficulty = shareChain->getNextShareDifficulty();
+    work.built = Simulator::Now();
+    return work;
+}
+
+void P2PoolNode::ScheduleTemplatePush()
+{
+    if (!templatePushDelay.IsStrictlyPositive() && !templateRefreshInterval.IsStrictlyPositive())
+    {
+        return;
+    }
+    if (!templatePushDelay.IsStrictlyPositive())
+    {
+        workTemplate = CreateWorkTemplate();
+    }
+    else if (!templatePushEvent.IsRunning())
+    {
+        // changes during the delay are picked up by the one pending push
+        templatePushEvent =
+            Simulator::Schedule(templatePushDelay, &P2PoolNode::PushWorkTemplate, this);
+    }
+}
+
+void P2PoolNode::PushWorkTemplate()
+{
+    workTemplate = CreateWorkTemplate();
+}
+
+void P2PoolNode::RefreshWorkTemplate()
 {
-    uint64_t timestamp = static_cast<uint64_t>(Simulator::Now().GetTimeStep());
-    uint64_t nodePrefix = static_cast<uint64_t>(nodeId) << 48;
-    uint64_t shareCount = static_cast<uint64_t>(sharesCreated) << 32;
-    uint64_t seed = nodePrefix | shareCount | (timestamp & 0xFFFFFFFF);
-    std::hash<uint64_t> hasher;
-    return static_cast<uint32_t>(hasher(seed));
+    workTemplate = CreateWorkTemplate();
+    templateRefreshEvent =
+        Simulator::Schedule(templateRefreshInterval, &P2PoolNode::RefreshWorkTemplate, this);
+}
+
+double P2PoolNode::GetWorkDifficulty() const
+{
+    if (templatePushDelay.IsStrictlyPositive() || templateRefreshInterval.IsStrictlyPositive())
+    {
+        return workTemplate.difficulty;
+    }
+    return shareChain->getNextShareDifficulty();
+}
+
+ShareId P2PoolNode::GenerateUniqueShareId()
+{
+    // the +1 keeps every mined ID clear of genesis (1) and "no share" (0)
+    return (static_cast<ShareId>(nodeId) + 1) << 32 | shareSequence++;
 }
 
 void P2PoolNode::ScheduleNextShareGeneration()
 {
-    double nextTime = std::max(0.1, shareGenTimeModel->GetValue());
+    if (!shareGenTimeModel)
+    {
+        return;
+    }
+    // the model draws times at base difficulty; harder shares take proportionally
+    // longer, and the share is stamped with the difficulty the time was drawn for
+    double difficulty = GetWorkDifficulty();
+    double nextTime = std::max(minShareInterval, shareGenTimeModel->GetValue() * difficulty);
 
     nextShareEvent = Simulator::Schedule(Seconds(nextTime),
                                            &P2PoolNode::GenerateAndBroadcastShare,
-                                           this);
+                                           this,
+                                           difficulty);
 }
 
 void P2PoolNode::BroadcastShare(Share* share)
 {
+    if (!online)
+    {
+        return;
+    }
     sharesSent++;
     for (auto& peer : peerSockets)
     {
+        if (blockedPeers.count(peer.first))
+        {
+            continue;
+        }
         SendShareToPeer(share,peer.second);
+        shareSentTrace(share, peer.first);
+    }
+}
+
+void P2PoolNode::PublishOwnShare(Share* share)
+{
+    if (minerStrategy == SELFISH_MINER)
+    {
+        withheldShares.push_back(share);
+    }
+    else if (minerStrategy == DELAYED_MINER)
+    {
+        Simulator::Schedule(releaseDelay, &P2PoolNode::BroadcastShare, this, share);
+    }
+    else
+    {
+        BroadcastShare(share);
+    }
+}
+
+void P2PoolNode::ReleaseWithheldShares(uint32_t competingHeight)
+{
+    // With a lead of one share or less the private branch is published
+    // whole, to win or at least race; a larger lead only matches the rival
+    uint32_t privateHeight = shareChain->getShareHeight(withheldShares.back()->getShareId());
+    bool releaseAll = privateHeight <= competingHeight + 1;
+    while (!withheldShares.empty() &&
+           (releaseAll ||
+            shareChain->getShareHeight(withheldShares.front()->getShareId()) <= competingHeight))
+    {
+        BroadcastShare(withheldShares.front());
+        withheldShares.pop_front();
     }
 }
 
 void P2PoolNode::SendShareToPeer(Share* share, Ptr<Socket> socket)
 {
-    std::string serializedShare = SerializeShare(share);
-    Ptr<Packet> packet =
-        Create<Packet>((uint8_t*)serializedShare.c_str(), serializedShare.size() + 1);
-    socket->Send(packet);
+    SendMessage(socket, SerializeShare(share));
+}
+
+void P2PoolNode::SendMessage(Ptr<Socket> socket, const std::string& message)
+{
+    std::string& buffer = sendBuffers[socket];
+    buffer.append(message);
+    buffer.push_back('\0');
+    FlushSendBuffer(socket);
+}
+
+void P2PoolNode::FlushSendBuffer(Ptr<Socket> socket)
+{
+    P2POOL_PROFILE_SCOPE("ns3 Socket::Send");
+    auto it = sendBuffers.find(socket);
+    if (it == sendBuffers.end())
+    {
+        return;
+    }
+    std::string& buffer = it->second;
+    size_t sent = 0;
+    while (sent < buffer.size())
+    {
+        uint32_t room = socket->GetTxAvailable();
+        if (room == 0)
+        {
+            break;
+        }
+        uint32_t chunk = std::min<size_t>(room, buffer.size() - sent);
+        int result = socket->Send(reinterpret_cast<const uint8_t*>(buffer.data() + sent), chunk, 0);
+        if (result <= 0)
+        {
+            break;
+        }
+        sent += result;
+    }
+    buffer.erase(0, sent);
+}
+
+void P2PoolNode::HandleSendReady(Ptr<Socket> socket, uint32_t)
+{
+    FlushSendBuffer(socket);
 }
 
 void P2PoolNode::HandleReceivedShare(Ptr<Socket> socket)
@@ -212,41 +443,639 @@ void P2PoolNode::HandleReceivedShare(Ptr<Socket> socket)
 
     Ptr<Packet> packet;
     Address from;
+    std::string& buffer = recvBuffers[socket];
 
-    while ((packet = socket->RecvFrom(from)))
+    while (true)
     {
+        {
+            P2POOL_PROFILE_SCOPE("ns3 Socket::RecvFrom");
+            packet = socket->RecvFrom(from);
+        }
+        if (!packet)
+        {
+            break;
+        }
         uint32_t size = packet->GetSize();
-        uint8_t* buffer = new uint8_t[size];
-        packet->CopyData(buffer, size);
-        std::string data(reinterpret_cast<char*>(buffer), size);
-        delete[] buffer;
-        if (data.find("REGISTER:") == 0)
-        {
-            size_t colonPos = data.find(":");
-            if (colonPos != std::string::npos)
+        size_t offset = buffer.size();
+        buffer.resize(offset + size);
+        packet->CopyData(reinterpret_cast<uint8_t*>(&buffer[offset]), size);
+    }
+
+    // TCP delivers a byte stream: a packet may hold several messages or
+    // only part of one, so split on the terminators and keep the remainder
+    std::string messages;
+    messages.swap(buffer);
+    size_t begin = 0;
+    size_t end;
+    while ((end = messages.find('\0', begin)) != std::string::npos)
+    {
+        HandleMessage(socket, messages.substr(begin, end - begin));
+        begin = end + 1;
+        if (!recvBuffers.count(socket))
+        {
+            // a DISCONNECT closed the socket; the rest is not read
+            return;
+        }
+    }
+    // handlers may have touched recvBuffers, so look the entry up again
+    recvBuffers[socket] = messages.substr(begin);
+}
+
+void P2PoolNode::HandleMessage(Ptr<Socket> socket, const std::string& data)
+{
+    if (data.find("REGISTER:") == 0)
+    {
+        size_t colonPos = data.find(":");
+        if (colonPos != std::string::npos)
+        {
+            uint32_t peerId = std::stoul(data.substr(colonPos + 1));
+            NS_LOG_INFO("Node " << nodeId << " received registration from peer " << peerId);
+            peerSockets[peerId] = socket;
+            if (!rewireInterval.IsZero())
+            {
+                peerScores[peerId] = PeerScore{Simulator::Now(), {}};
+            }
+            if (syncRequested && !syncSocket)
             {
-                uint32_t peerId = std::stoul(data.substr(colonPos + 1));
-                NS_LOG_INFO("Node " << nodeId << " received registration from peer " << peerId);
-                peerSockets[peerId] = socket;
+                SendSyncRequest(socket);
             }
         }
+    }
+    else if (data.find("DISCONNECT:") == 0)
+    {
+        // the peer dropped us; forget the connection
+        uint32_t peerId = std::stoul(data.substr(11));
+        auto peer = peerSockets.find(peerId);
+        if (peer != peerSockets.end() && peer->second == socket)
+        {
+            NS_LOG_INFO("Node " << nodeId << " was dropped by peer " << peerId);
+            peerSockets.erase(peer);
+            peerScores.erase(peerId);
+            CloseSocket(socket);
+        }
+    }
+    else if (!online || blockedPeers.count(GetPeerId(socket)))
+    {
+        // the node or the link is down: the message is lost
+        NS_LOG_DEBUG("Node " << nodeId << " drops a message from peer " << GetPeerId(socket));
+    }
+    else if (data.find("SYNC:") == 0)
+    {
+        ServeSync(socket, data.substr(5));
+    }
+    else if (data.find("HEADERS:") == 0)
+    {
+        HandleHeaders(data.substr(8));
+    }
+    else if (data.find("SHARES:") == 0)
+    {
+        HandleShareBatch(data.substr(7));
+    }
+    else
+    {
+        HandleGossipShare(socket, data);
+    }
+}
+
+void P2PoolNode::HandleGossipShare(Ptr<Socket> socket, const std::string& data)
+{
+    Share* receivedShare = DeserializeShare(data);
+    if (!receivedShare)
+    {
+        NS_LOG_WARN("Node " << nodeId << " dropped a malformed share message");
+    }
+    else if (existingShares.find(receivedShare->getShareId()) != existingShares.end())
+    {
+        NS_LOG_INFO("Node " << nodeId << " already processed share " << receivedShare->getShareId() << ":"
+                            << receivedShare->getShareId());
+        shareDuplicateTrace(receivedShare);
+        RecordDelivery(GetPeerId(socket), receivedShare->getShareId(), false);
+        delete receivedShare;
+    }
+    else
+    {
+        shareReceivedTrace(receivedShare);
+        RecordDelivery(GetPeerId(socket), receivedShare->getShareId(), true);
+        if (propagationTracker)
+        {
+            propagationTracker->RecordReceived(receivedShare->getShareId(),
+                                               nodeId,
+                                               GetPeerId(socket),
+                                               Simulator::Now());
+        }
+        existingShares.insert(receivedShare->getShareId());
+        sharesReceived++;
+        if (validationFixedCost.IsZero() && validationPerRefCost.IsZero())
+        {
+            ConnectAndRelay(receivedShare);
+            return;
+        }
+        QueuedShare queued = {receivedShare, Simulator::Now()};
+        if (validationPriority && receivedShare->getParentId() == shareChain->getBestTip())
+        {
+            priorityQueue.push_back(queued);
+        }
         else
         {
-        Share* receivedShare = DeserializeShare(data);
-        if (existingShares.find(receivedShare->getShareId()) != existingShares.end())
+            validationQueue.push_back(queued);
+        }
+        maxQueueLength =
+            std::max(maxQueueLength, validationQueue.size() + priorityQueue.size());
+        StartValidation();
+    }
+}
+
+void P2PoolNode::ConnectAndRelay(Share* share)
+{
+    LogArrival(share);
+    shareChain->addShare(share);
+    BroadcastShare(share);
+}
+
+void P2PoolNode::StartValidation()
+{
+    while (busyWorkers < validationWorkers && !(priorityQueue.empty() && validationQueue.empty()))
+    {
+        std::deque<QueuedShare>& queue = priorityQueue.empty() ? validationQueue : priorityQueue;
+        QueuedShare next = queue.front();
+        queue.pop_front();
+        queueDelays.add((Simulator::Now() - next.enqueued).GetSeconds());
+        busyWorkers++;
+        Time cost = validationFixedCost +
+                    validationPerRefCost * static_cast<int64_t>(next.share->getPrevRefs().size());
+        Simulator::Schedule(cost, &P2PoolNode::FinishValidation, this, next.share);
+    }
+}
+
+void P2PoolNode::FinishValidation(Share* share)
+{
+    busyWorkers--;
+    ConnectAndRelay(share);
+    StartValidation();
+}
+
+void P2PoolNode::SetValidationCost(ns3::Time fixedCost,
+                                   ns3::Time perRefCost,
+                                   uint32_t workers,
+                                   bool priority)
+{
+    validationFixedCost = fixedCost;
+    validationPerRefCost = perRefCost;
+    validationWorkers = std::max<uint32_t>(workers, 1);
+    validationPriority = priority;
+}
+
+void P2PoolNode::SetMinerStrategy(MinerStrategy strategy, ns3::Time delay)
+{
+    minerStrategy = strategy;
+    releaseDelay = delay;
+}
+
+P2PoolNode::MinerStrategy P2PoolNode::GetMinerStrategy() const
+{
+    return minerStrategy;
+}
+
+void P2PoolNode::EnablePeerRewiring(ns3::Time interval,
+                                    uint32_t degree,
+                                    const std::vector<Ipv4Address>& directory)
+{
+    rewireInterval = interval;
+    maxDegree = degree;
+    peerDirectory = directory;
+    peerPicker = CreateObject<UniformRandomVariable>();
+    roundStart = Simulator::Now();
+    rewireEvent = Simulator::Schedule(rewireInterval, &P2PoolNode::RewirePeers, this);
+}
+
+void P2PoolNode::SetWorkTemplate(ns3::Time pushDelay, ns3::Time refreshInterval)
+{
+    templatePushDelay = pushDelay;
+    templateRefreshInterval = refreshInterval;
+}
+
+uint32_t P2PoolNode::GetStaleWorkShares() const
+{
+    return staleWorkShares.size();
+}
+
+uint32_t P2PoolNode::GetStaleWorkOrphans() const
+{
+    uint32_t orphans = 0;
+    for (ShareId shareId : staleWorkShares)
+    {
+        if (!shareChain->isOnMainChain(shareId))
         {
-            NS_LOG_INFO("Node " << nodeId << " already processed share " << receivedShare->getShareId() << ":"
-                                << receivedShare->getShareId());
+            orphans++;
         }
-        else if (receivedShare)
+    }
+    return orphans;
+}
+
+ns3::Time P2PoolNode::GetTemplateAgeSum() const
+{
+    return templateAgeSum;
+}
+
+uint32_t P2PoolNode::GetPeersDropped() const
+{
+    return peersDropped;
+}
+
+uint32_t P2PoolNode::GetPeersDialled() const
+{
+    return peersDialled;
+}
+
+size_t P2PoolNode::GetPeerCount() const
+{
+    return peerSockets.size();
+}
+
+void P2PoolNode::RecordDelivery(uint32_t peerId, ShareId shareId, bool first)
+{
+    if (rewireInterval.IsZero() || peerId == nodeId)
+    {
+        return;
+    }
+    if (first)
+    {
+        roundFirstSeen[shareId] = Simulator::Now();
+        peerScores[peerId].delays.push_back(0.0f);
+        return;
+    }
+    auto firstSeen = roundFirstSeen.find(shareId);
+    if (firstSeen != roundFirstSeen.end())
+    {
+        peerScores[peerId].delays.push_back((Simulator::Now() - firstSeen->second).GetSeconds());
+    }
+}
+
+double P2PoolNode::ScorePeer(const std::vector<float>& delays) const
+{
+    // shares the peer never delivered count as a whole interval
+    std::vector<float> all(delays);
+    all.resize(std::max(all.size(), roundFirstSeen.size()), rewireInterval.GetSeconds());
+    size_t rank = all.size() * 9 / 10;
+    std::nth_element(all.begin(), all.begin() + rank, all.end());
+    return all[rank];
+}
+
+void P2PoolNode::RewirePeers()
+{
+    if (online && !roundFirstSeen.empty())
+    {
+        // Only peers we had for the whole round are scored; the sync peer
+        // is kept until the sync is done
+        std::vector<std::pair<double, uint32_t>> scores;
+        for (const auto& peer : peerSockets)
+        {
+            auto score = peerScores.find(peer.first);
+            if (peer.second == syncSocket || score == peerScores.end() ||
+                score->second.since > roundStart)
+            {
+                continue;
+            }
+            scores.push_back({ScorePeer(score->second.delays), peer.first});
+        }
+        std::sort(scores.rbegin(), scores.rend());
+        size_t dropped = 0;
+        for (const auto& score : scores)
+        {
+            if (peerSockets.size() <= 1 || (dropped > 0 && peerSockets.size() <= maxDegree))
+            {
+                break;
+            }
+            DropPeer(score.second);
+            dropped++;
+        }
+        if (peerSockets.size() < maxDegree)
+        {
+            DialRandomPeer();
+        }
+    }
+    roundFirstSeen.clear();
+    for (auto& score : peerScores)
+    {
+        score.second.delays.clear();
+    }
+    roundStart = Simulator::Now();
+    rewireEvent = Simulator::Schedule(rewireInterval, &P2PoolNode::RewirePeers, this);
+}
+
+void P2PoolNode::DropPeer(uint32_t peerId)
+{
+    auto peer = peerSockets.find(peerId);
+    if (peer == peerSockets.end())
+    {
+        return;
+    }
+    NS_LOG_INFO("Node " << nodeId << " drops peer " << peerId);
+    Ptr<Socket> peerSocket = peer->second;
+    SendMessage(peerSocket, "DISCONNECT:" + std::to_string(nodeId));
+    // TCP still delivers the queued bytes before its FIN
+    CloseSocket(peerSocket);
+    peerSockets.erase(peer);
+    peerScores.erase(peerId);
+    peersDropped++;
+}
+
+void P2PoolNode::CloseSocket(Ptr<Socket> socket)
+{
+    // the buffer maps hold the socket alive until its entries are gone
+    socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket>>());
+    socket->Close();
+    sendBuffers.erase(socket);
+    recvBuffers.erase(socket);
+}
+
+void P2PoolNode::DialRandomPeer()
+{
+    std::vector<uint32_t> candidates;
+    for (uint32_t k = 0; k < peerDirectory.size(); ++k)
+    {
+        if (k != nodeId && !peerSockets.count(k) && !blockedPeers.count(k))
+        {
+            candidates.push_back(k);
+        }
+    }
+    if (candidates.empty())
+    {
+        return;
+    }
+    uint32_t peerId = candidates[peerPicker->GetInteger(0, candidates.size() - 1)];
+    Ptr<Socket> peerSocket = Socket::CreateSocket(GetNode(), TcpSocketFactory::GetTypeId());
+    peerSocket->Connect(InetSocketAddress(peerDirectory[peerId], peerId + 1000));
+    NS_LOG_INFO("Node " << nodeId << " dials peer " << peerId);
+    AddPeerSocket(peerId, peerSocket);
+    peersDialled++;
+}
+
+const LatencySketch& P2PoolNode::GetQueueDelays() const
+{
+    return queueDelays;
+}
+
+size_t P2PoolNode::GetMaxQueueLength() const
+{
+    return maxQueueLength;
+}
+
+void P2PoolNode::RequestSync()
+{
+    syncRequested = true;
+    syncRequestTime = Simulator::Now();
+    if (!peerSockets.empty())
+    {
+        SendSyncRequest(peerSockets.begin()->second);
+    }
+}
+
+void P2PoolNode::ResyncWith(uint32_t peerId)
+{
+    auto peer = peerSockets.find(peerId);
+    if (!online || peer == peerSockets.end() || blockedPeers.count(peerId))
+    {
+        return;
+    }
+    SendSyncRequest(peer->second);
+}
+
+void P2PoolNode::SetPeerBlocked(uint32_t peerId, bool blocked)
+{
+    if (blocked)
+    {
+        blockedPeers.insert(peerId);
+    }
+    else if (blockedPeers.erase(peerId))
+    {
+        // catch up with what the peer found while the link was down
+        ResyncWith(peerId);
+    }
+}
+
+void P2PoolNode::GoOffline()
+{
+    NS_LOG_INFO("Node " << nodeId << " goes offline");
+    online = false;
+    StopShareGeneration();
+}
+
+void P2PoolNode::GoOnline()
+{
+    NS_LOG_INFO("Node " << nodeId << " comes back online");
+    online = true;
+    for (const auto& peer : peerSockets)
+    {
+        if (!blockedPeers.count(peer.first))
+        {
+            ResyncWith(peer.first);
+            break;
+        }
+    }
+    ScheduleNextShareGeneration();
+}
+
+bool P2PoolNode::IsOnline() const
+{
+    return online;
+}
+
+void P2PoolNode::SendSyncRequest(Ptr<Socket> socket)
+{
+    syncSocket = socket;
+    std::stringstream ss;
+    ss << "SYNC:";
+    std::vector<ShareId> locator = shareChain->getLocator();
+    for (size_t i = 0; i < locator.size(); ++i)
+    {
+        ss << (i ? "," : "") << locator[i];
+    }
+    NS_LOG_INFO("Node " << nodeId << " requests sync from peer " << GetPeerId(socket) << " with "
+                        << locator.size() << " locator entries");
+    SendMessage(socket, ss.str());
+}
+
+void P2PoolNode::ServeSync(Ptr<Socket> socket, const std::string& locatorData)
+{
+    P2POOL_PROFILE_SCOPE("P2PoolNode::ServeSync");
+    std::vector<ShareId> locator;
+    std::stringstream ls(locatorData);
+    std::string token;
+    while (std::getline(ls, token, ','))
+    {
+        if (!token.empty())
+        {
+            locator.push_back(std::stoull(token));
+        }
+    }
+    ShareId fork = shareChain->findForkPoint(locator);
+    std::vector<ShareId> headers = shareChain->getMainChainAfter(fork);
+    // everything above the fork point and the uncles it references; the peer
+    // drops what it has
+    std::vector<const Share*> shares = shareChain->getSharesAbove(fork);
+
+    std::stringstream hs;
+    hs << "HEADERS:" << shares.size() << "|" << shareChain->getBestTip() << "|";
+    for (size_t i = 0; i < headers.size(); ++i)
+    {
+        hs << (i ? "," : "") << headers[i];
+    }
+    SendMessage(socket, hs.str());
+
+    for (size_t first = 0; first < shares.size(); first += syncBatchSize)
+    {
+        size_t last = std::min(shares.size(), first + syncBatchSize);
+        std::string batch = "SHARES:";
+        for (size_t i = first; i < last; ++i)
+        {
+            batch += SerializeShare(const_cast<Share*>(shares[i]));
+            batch += '\n';
+        }
+        SendMessage(socket, batch);
+    }
+    NS_LOG_INFO("Node " << nodeId << " serves " << shares.size() << " shares above fork point "
+                        << fork << " to peer " << GetPeerId(socket));
+}
+
+void P2PoolNode::HandleHeaders(const std::string& data)
+{
+    std::stringstream ss(data);
+    std::string count;
+    std::string tip;
+    std::string token;
+    std::getline(ss, count, '|');
+    std::getline(ss, tip, '|');
+    uint32_t expected;
+    ShareId target;
+    std::vector<ShareId> headers;
+    try
+    {
+        expected = std::stoul(count);
+        target = std::stoull(tip);
+        while (std::getline(ss, token, ','))
+        {
+            headers.push_back(std::stoull(token));
+        }
+    }
+    catch (const std::exception& e)
+    {
+        NS_LOG_WARN("Node " << nodeId << " dropped malformed sync headers");
+        return;
+    }
+    NS_LOG_INFO("Node " << nodeId << " expects " << expected << " shares, target tip " << target);
+    // resyncs after churn may overlap; the join measurements follow the first sync
+    syncExpected += expected;
+    syncHeaders.insert(syncHeaders.end(), headers.begin(), headers.end());
+    if (syncRequested && syncTarget == 0)
+    {
+        syncTarget = target;
+    }
+    if (syncExpected == 0)
+    {
+        CheckSyncHeaders();
+        if (syncRequested && syncCompleteTime.IsZero())
+        {
+            syncCompleteTime = Simulator::Now();
+        }
+    }
+    CheckCaughtUp();
+}
+
+void P2PoolNode::CheckSyncHeaders()
+{
+    // every main-chain share the peers announced must have connected
+    uint32_t missing = 0;
+    for (ShareId header : syncHeaders)
+    {
+        if (shareChain->getShareHeight(header) == 0)
         {
-            shareChain->addShare(receivedShare);
-            BroadcastShare(receivedShare);
-            existingShares.insert(receivedShare->getShareId());
-            sharesReceived++;
+            missing++;
         }
-     }
     }
+    if (missing > 0)
+    {
+        NS_LOG_WARN("Node " << nodeId << " synced without " << missing << " of "
+                            << syncHeaders.size() << " announced main-chain shares");
+    }
+    syncHeaders.clear();
+}
+
+void P2PoolNode::HandleShareBatch(const std::string& data)
+{
+    P2POOL_PROFILE_SCOPE("P2PoolNode::HandleShareBatch");
+    std::stringstream ss(data);
+    std::string line;
+    uint32_t received = 0;
+    std::vector<Share*> batch;
+    while (std::getline(ss, line, '\n'))
+    {
+        received++;
+        Share* share = DeserializeShare(line);
+        if (!share)
+        {
+            continue;
+        }
+        if (existingShares.insert(share->getShareId()).second)
+        {
+            LogArrival(share);
+            batch.push_back(share);
+        }
+        else
+        {
+            delete share;
+        }
+    }
+    // batches arrive in topological order, so the chain can connect them
+    // in one pass and weigh only the tips the batch leaves
+    shareChain->addShares(batch);
+    syncedShares += batch.size();
+    syncExpected -= std::min(syncExpected, received);
+    if (syncExpected == 0)
+    {
+        CheckSyncHeaders();
+    }
+    if (syncExpected == 0 && syncRequested && syncCompleteTime.IsZero())
+    {
+        syncCompleteTime = Simulator::Now();
+        NS_LOG_INFO("Node " << nodeId << " finished sync with " << syncedShares << " new shares in "
+                            << (syncCompleteTime - syncRequestTime).GetSeconds() << "s");
+    }
+    CheckCaughtUp();
+}
+
+void P2PoolNode::CheckCaughtUp()
+{
+    // caught up once the tip the sync peer advertised is on our main chain
+    if (syncTarget != 0 && catchUpTime.IsZero() && shareChain->isOnMainChain(syncTarget))
+    {
+        catchUpTime = Simulator::Now();
+    }
+}
+
+void P2PoolNode::SetSyncBatchSize(uint32_t batchSize)
+{
+    syncBatchSize = std::max<uint32_t>(batchSize, 1);
+}
+
+uint32_t P2PoolNode::GetSyncedShares() const
+{
+    return syncedShares;
+}
+
+ns3::Time P2PoolNode::GetSyncRequestTime() const
+{
+    return syncRequestTime;
+}
+
+ns3::Time P2PoolNode::GetSyncCompleteTime() const
+{
+    return syncCompleteTime;
+}
+
+ns3::Time P2PoolNode::GetCatchUpTime() const
+{
+    return catchUpTime;
 }
 
 bool P2PoolNode::ConnectionRequestCallback(Ptr<Socket> socket, const Address& address)
@@ -257,10 +1086,12 @@ bool P2PoolNode::ConnectionRequestCallback(Ptr<Socket> socket, const Address& ad
 void P2PoolNode::ConnectionAcceptedCallback(Ptr<Socket> socket, const Address& address)
 {
     socket->SetRecvCallback(MakeCallback(&P2PoolNode::HandleReceivedShare, this));
+    socket->SetSendCallback(MakeCallback(&P2PoolNode::HandleSendReady, this));
 }
 
 std::string P2PoolNode::SerializeShare(Share* share)
 {
+    P2POOL_PROFILE_SCOPE("P2PoolNode::SerializeShare");
     if (!share)
     {
         return "";
@@ -269,10 +1100,10 @@ std::string P2PoolNode::SerializeShare(Share* share)
     std::stringstream ss;
     ss << share->getShareId() << "|";
     ss << share->getSenderId() << "|";
-    ss << share->getTimestamp().GetSeconds() << "|";
+    ss << share->getTimestamp().GetNanoSeconds() << "|";
     ss << share->getParentId()<< "|";
     
-    const std::vector<uint32_t>& prevRefs = share->getPrevRefs();
+    const std::vector<ShareId>& prevRefs = share->getPrevRefs();
     ss << prevRefs.size() << "|";
 
     for (size_t i = 0; i < prevRefs.size(); ++i)
@@ -283,17 +1114,75 @@ std::string P2PoolNode::SerializeShare(Share* share)
             ss << ",";
         }
     }
+    ss << "|" << std::setprecision(17) << share->getDifficulty();
     return ss.str();
 }
 
 void P2PoolNode::AddPeerSocket(uint32_t peerId, Ptr<Socket> socket)
 {
+    socket->SetRecvCallback(MakeCallback(&P2PoolNode::HandleReceivedShare, this));
+    socket->SetSendCallback(MakeCallback(&P2PoolNode::HandleSendReady, this));
     peerSockets[peerId] = socket;
+    if (!rewireInterval.IsZero())
+    {
+        peerScores[peerId] = PeerScore{Simulator::Now(), {}};
+    }
+    SendMessage(socket, "REGISTER:" + std::to_string(nodeId));
     NS_LOG_INFO("Node " << nodeId << " added socket connection to peer " << peerId);
 }
 
+void P2PoolNode::SetPropagationTracker(PropagationTracker* tracker)
+{
+    propagationTracker = tracker;
+}
+
+void P2PoolNode::SetEventLog(EventLogWriter* log)
+{
+    eventLog = log;
+}
+
+bool P2PoolNode::LoadSnapshot(const std::string& path, ns3::Time shift)
+{
+    NS_LOG_FUNCTION(this << path);
+    if (!shareChain->loadSnapshot(path, ToShareTime(shift)))
+    {
+        return false;
+    }
+    for (const auto& entry : shareChain->getAllShareVertices())
+    {
+        existingShares.insert(entry.first);
+        // continue our own sequence past the shares we mined in that run
+        if (entry.first >> 32 == static_cast<ShareId>(nodeId) + 1)
+        {
+            shareSequence = std::max(shareSequence, static_cast<uint32_t>(entry.first) + 1);
+        }
+    }
+    return true;
+}
+
+void P2PoolNode::LogArrival(const Share* share)
+{
+    if (eventLog)
+    {
+        eventLog->logArrival(ToShareTime(Simulator::Now()), nodeId, *share);
+    }
+}
+
+uint32_t P2PoolNode::GetPeerId(Ptr<Socket> socket) const
+{
+    for (const auto& peer : peerSockets)
+    {
+        if (peer.second == socket)
+        {
+            return peer.first;
+        }
+    }
+    return nodeId;
+}
+
 Share* P2PoolNode::DeserializeShare(const std::string& data)
 {
+    P2POOL_PROFILE_SCOPE("P2PoolNode::DeserializeShare");
     std::stringstream ss(data);
     std::string token;
     std::vector<std::string> tokens;
@@ -308,13 +1197,13 @@ Share* P2PoolNode::DeserializeShare(const std::string& data)
 
     try
     {
-        uint32_t shareId = std::stoul(tokens[0]);
+        ShareId shareId = std::stoull(tokens[0]);
         uint32_t senderId = std::stoul(tokens[1]);
-        ns3::Time timestamp = Seconds(std::stoll(tokens[2]));
-        uint32_t parentId = std::stoll(tokens[3]);
+        ShareTime timestamp = ShareTime::FromNanoSeconds(std::stoll(tokens[2]));
+        ShareId parentId = std::stoull(tokens[3]);
         uint32_t numRefs = std::stoul(tokens[4]);
 
-        std::vector<uint32_t> prevRefs;
+        std::vector<ShareId> prevRefs;
 
         if (tokens.size() > 5 && numRefs > 0)
         {
@@ -325,12 +1214,13 @@ Share* P2PoolNode::DeserializeShare(const std::string& data)
             {
                 if (!refToken.empty())
                 {
-                    uint32_t refShareId = std::stoul(refToken);
+                    ShareId refShareId = std::stoull(refToken);
                     prevRefs.push_back(refShareId);
                 }
             }
         }
-        return new Share(shareId, senderId, timestamp, prevRefs,parentId);
+        double difficulty = tokens.size() > 6 ? std::stod(tokens[6]) : 1.0;
+        return new Share(shareId, senderId, timestamp, prevRefs,parentId,difficulty);
     }
     catch (const std::exception& e)
     {
@@ -343,7 +1233,37 @@ NS_OBJECT_ENSURE_REGISTERED(P2PoolNode);
 TypeId P2PoolNode::GetTypeId(void)
 {
     static TypeId tid =
-        TypeId("ns3::P2Pool::P2PoolNode").SetParent<Application>().SetGroupName("P2Pool");
+        TypeId("ns3::P2Pool::P2PoolNode")
+            .SetParent<Application>()
+            .SetGroupName("P2Pool")
+            .AddTraceSource("ShareGenerated",
+                            "A share was created by this node",
+                            MakeTraceSourceAccessor(&P2PoolNode::shareGeneratedTrace),
+                            "P2PoolNode::ShareTracedCallback")
+            .AddTraceSource("ShareReceived",
+                            "A share was received from a peer for the first time",
+                            MakeTraceSourceAccessor(&P2PoolNode::shareReceivedTrace),
+                            "P2PoolNode::ShareTracedCallback")
+            .AddTraceSource("ShareDuplicate",
+                            "An already processed share was received and dropped",
+                            MakeTraceSourceAccessor(&P2PoolNode::shareDuplicateTrace),
+                            "P2PoolNode::ShareTracedCallback")
+            .AddTraceSource("SharePending",
+                            "A share was parked until its references arrive",
+                            MakeTraceSourceAccessor(&P2PoolNode::sharePendingTrace),
+                            "P2PoolNode::ShareTracedCallback")
+            .AddTraceSource("ShareConnected",
+                            "A share was connected to the local share chain",
+                            MakeTraceSourceAccessor(&P2PoolNode::shareConnectedTrace),
+                            "P2PoolNode::ShareTracedCallback")
+            .AddTraceSource("BestTipChanged",
+                            "The heaviest tip of the local share chain changed",
+                            MakeTraceSourceAccessor(&P2PoolNode::bestTipChangedTrace),
+                            "P2PoolNode::BestTipTracedCallback")
+            .AddTraceSource("ShareSent",
+                            "A share was sent to a peer",
+                            MakeTraceSourceAccessor(&P2PoolNode::shareSentTrace),
+                            "P2PoolNode::ShareSentTracedCallback");
     return tid;
 }
 
@@ -1,3 +1,6 @@
+#include "eventlog.h"
+#include "ns3chain.h"
+#include "propagationtracker.h"
 #include "share.h"
 #include "sharechain.h"
 
@@ -12,8 +15,10 @@
 #include "ns3/simulator.h"
 #include "ns3/socket.h"
 #include "ns3/tcp-socket.h"
+#include "ns3/traced-callback.h"
 
 #include <ctime>
+#include <deque>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -28,10 +33,29 @@ class P2PoolNode : public Application
   public:
     static TypeId GetTypeId(void);
 
+    // Signatures of the trace sources
+    typedef void (*ShareTracedCallback)(const Share* share);
+    typedef void (*BestTipTracedCallback)(ShareId oldTip, ShareId newTip);
+    typedef void (*ShareSentTracedCallback)(const Share* share, uint32_t peerId);
+
+    // How a node publishes the shares it finds (see SetMinerStrategy)
+    enum MinerStrategy
+    {
+        HONEST_MINER,
+        SELFISH_MINER,
+        DELAYED_MINER
+    };
+
+    /**
+     * @param shareGenTimeModel Draws the time to the next share in seconds;
+     *        null if shares are triggered externally (GenerateAndBroadcastShare)
+     * @param minShareInterval Lower bound applied to every drawn interval
+     */
     P2PoolNode(uint32_t P2PoolNodeId,
-               Ptr<NormalRandomVariable> shareGenTimeModel,
+               Ptr<RandomVariableStream> shareGenTimeModel,
                uint32_t maxTipsToReference,
-               ns3::Time max_share_time);
+               ns3::Time max_share_time,
+               double minShareInterval = 0.0);
     virtual ~P2PoolNode();
 
     // Get P2PoolNode ID
@@ -40,37 +64,222 @@ class P2PoolNode : public Application
     // Get local ShareChain
     ShareChain* GetShareChain() const;
 
+    // Adopt a socket dialled to a peer and register with it
     void AddPeerSocket(uint32_t peerId, Ptr<Socket> socket);
 
+    /**
+     * Catch up with the network: ask the first connected peer (or the first
+     * to register, if none is connected yet) for the shares we are missing.
+     * The peer answers with the main chain above our locator's fork point
+     * (HEADERS) and then streams the shares in topological order in batches
+     * of syncBatchSize (SHARES).
+     */
+    void RequestSync();
+
+    // Ask a specific peer for the shares we are missing (e.g. after a heal)
+    void ResyncWith(uint32_t peerId);
+
+    /**
+     * Link gating for churn and partitions. A blocked peer's messages are
+     * dropped and nothing is sent to it; the TCP connection stays up.
+     * Unblocking resyncs with the peer.
+     */
+    void SetPeerBlocked(uint32_t peerId, bool blocked);
+
+    // Leave the network: stop mining and drop all traffic, keeping the chain
+    void GoOffline();
+
+    // Rejoin: resync with a reachable peer and resume mining
+    void GoOnline();
+
+    bool IsOnline() const;
+
+    /**
+     * Simulated validation CPU cost of received shares. A share costs
+     * fixedCost plus perRefCost per reference and holds one of workers
+     * slots meanwhile; it is connected and relayed when validation ends.
+     * Waiting shares are served in arrival order, or with priority set,
+     * shares building on the current best tip go first. A zero cost keeps
+     * validation instantaneous.
+     */
+    void SetValidationCost(ns3::Time fixedCost,
+                           ns3::Time perRefCost,
+                           uint32_t workers,
+                           bool priority);
+
+    /**
+     * Publication strategy for the node's own shares. An honest miner sends
+     * every share as soon as it is found. A selfish miner keeps its shares
+     * private and mines on top of them; when another miner's share connects,
+     * it publishes its private shares up to that share's height, or all of
+     * them once its lead is down to one share. A delayed miner sends every
+     * share releaseDelay after finding it.
+     */
+    void SetMinerStrategy(MinerStrategy strategy, ns3::Time releaseDelay);
+    MinerStrategy GetMinerStrategy() const;
+
+    /**
+     * Latency-aware peer selection. Every interval the node scores each
+     * peer it has had for the whole interval by the 90th percentile of the
+     * delay between a share's first delivery (by any peer) and its delivery
+     * by that peer; shares the peer never delivered count as a whole
+     * interval. The worst peer is dropped (more while above maxDegree) and,
+     * below maxDegree, a random node from directory (indexed by node ID) is
+     * dialled over the routed network.
+     */
+    void EnablePeerRewiring(ns3::Time interval,
+                            uint32_t maxDegree,
+                            const std::vector<Ipv4Address>& directory);
+
+    /**
+     * Mining work template model. Shares are built from a template of
+     * referenced tips and parent that lags the chain: after a best-tip
+     * change the node pushes a new template to its miners pushDelay later,
+     * and it also rebuilds the template every refreshInterval. A share
+     * found on a template whose parent the best chain has already grown
+     * past counts as stale work. Both zero (the default) builds every share
+     * from the chain as it is at that instant.
+     */
+    void SetWorkTemplate(ns3::Time pushDelay, ns3::Time refreshInterval);
+
+    // Shares found on stale work, those still off our main chain, and the
+    // summed age of the templates shares were found on
+    uint32_t GetStaleWorkShares() const;
+    uint32_t GetStaleWorkOrphans() const;
+    ns3::Time GetTemplateAgeSum() const;
+
+    // Rewiring counters and the current number of peers
+    uint32_t GetPeersDropped() const;
+    uint32_t GetPeersDialled() const;
+    size_t GetPeerCount() const;
+
+    // Time received shares waited for a validation slot, in seconds
+    const LatencySketch& GetQueueDelays() const;
+    size_t GetMaxQueueLength() const;
+
+    // Shares per SHARES message when serving a sync
+    void SetSyncBatchSize(uint32_t batchSize);
+
+    // Sync measurements; times are zero until the event happened
+    uint32_t GetSyncedShares() const;
+    ns3::Time GetSyncRequestTime() const;
+    ns3::Time GetSyncCompleteTime() const;
+    ns3::Time GetCatchUpTime() const;
+
+    // Report share creation and first arrivals to a simulation-wide tracker
+    void SetPropagationTracker(PropagationTracker* tracker);
+
+    // Record every share handed to the local chain for offline replay
+    void SetEventLog(EventLogWriter* log);
+
+    /**
+     * Preload the local chain from a ShareChain snapshot before the
+     * simulation starts, with every timestamp moved by shift.
+     * @return false if the snapshot could not be loaded
+     */
+    bool LoadSnapshot(const std::string& path, ns3::Time shift);
+
     // Stop generating shares
     void StopShareGeneration();
 
     // Get orphan count
     uint32_t getOrphanCount() const;
 
+    // Get share counters
+    uint32_t GetSharesCreated() const;
+    uint32_t GetSharesReceived() const;
+    uint32_t GetSharesSent() const;
+
     // Print chain stats
     void PrintChainStats() const;
 
-    // Handle received share from peer
+    // Read a socket and handle every complete message in it
     void HandleReceivedShare(Ptr<Socket> socket);
 
-    // Schedule next share generation
+    // Close a peer socket and drop its receive callback and buffers
+    void CloseSocket(Ptr<Socket> socket);
+
+    // Send buffered messages once the socket has room again
+    void HandleSendReady(Ptr<Socket> socket, uint32_t /* available */);
+
+    // Schedule next share generation (no-op without a share generation model)
     void ScheduleNextShareGeneration();
 
+    // Generate a new share at the difficulty its arrival time was drawn for,
+    // and broadcast it to all peers
+    void GenerateAndBroadcastShare(double difficulty);
+
+    // Difficulty of the work the node's miners are on (template or chain)
+    double GetWorkDifficulty() const;
+
   protected:
     virtual void StartApplication(void);
     virtual void StopApplication(void);
 
   private:
-    // Generate a new share and broadcast to all peers
-    void GenerateAndBroadcastShare();
-
     // Broadcast a share to all peers
     void BroadcastShare(Share* share);
 
+    // Referenced tips, parent and difficulty a new share is built from
+    struct WorkTemplate
+    {
+        std::vector<ShareId> refs;
+        ShareId parent;
+        double difficulty;
+        ns3::Time built;
+    };
+
+    // Build work from the chain as it is now
+    WorkTemplate CreateWorkTemplate() const;
+
+    // Work template model: push new work after a best-tip change, refresh
+    void ScheduleTemplatePush();
+    void PushWorkTemplate();
+    void RefreshWorkTemplate();
+
+    // Send a share this node found, or hold it back, per the miner strategy
+    void PublishOwnShare(Share* share);
+
+    // Selfish mining: publish private shares against a competing height
+    void ReleaseWithheldShares(uint32_t competingHeight);
+
     // Send a share to a specific peer
     void SendShareToPeer(Share* share, Ptr<Socket> socket);
 
+    // Queue a NUL-terminated message on a socket and send what fits
+    void SendMessage(Ptr<Socket> socket, const std::string& message);
+    void FlushSendBuffer(Ptr<Socket> socket);
+
+    // Dispatch one complete message
+    void HandleMessage(Ptr<Socket> socket, const std::string& data);
+    void HandleGossipShare(Ptr<Socket> socket, const std::string& data);
+
+    // Validation queue: start free workers, and finish one share
+    void StartValidation();
+    void FinishValidation(Share* share);
+
+    // Add a validated share to the chain and relay it
+    void ConnectAndRelay(Share* share);
+
+    // Peer rewiring: note a share delivery, run a round, score, drop, dial
+    void RecordDelivery(uint32_t peerId, ShareId shareId, bool first);
+    void RewirePeers();
+    double ScorePeer(const std::vector<float>& delays) const;
+    void DropPeer(uint32_t peerId);
+    void DialRandomPeer();
+
+    // Append a share the local chain is about to see to the event log
+    void LogArrival(const Share* share);
+
+    // Sync protocol: request, serve, and consume headers and share batches
+    void SendSyncRequest(Ptr<Socket> socket);
+    void ServeSync(Ptr<Socket> socket, const std::string& locator);
+    void HandleHeaders(const std::string& data);
+    void HandleShareBatch(const std::string& data);
+    void CheckCaughtUp();
+    // Warn about announced main-chain shares a finished sync left unconnected
+    void CheckSyncHeaders();
+
     // New connection callback
     void ConnectionAcceptedCallback(Ptr<Socket> socket, const Address& address);
 
@@ -86,8 +295,11 @@ class P2PoolNode : public Application
     // Deserialize share from network data
     Share* DeserializeShare(const std::string& data);
 
-    //Generates unique shareid when creating new shareId
-    uint32_t GenerateUniqueShareId();
+    // Next share ID: ((nodeId + 1) << 32) | sequence, unique by construction
+    ShareId GenerateUniqueShareId();
+
+    // Peer ID behind a connected socket, or nodeId if the peer is unknown
+    uint32_t GetPeerId(Ptr<Socket> socket) const;
 
     // P2PoolNode ID
     uint32_t nodeId;
@@ -99,7 +311,8 @@ class P2PoolNode : public Application
     uint32_t maxTipsToReference;
 
     // Random variable for share generation times
-    Ptr<NormalRandomVariable> shareGenTimeModel;
+    Ptr<RandomVariableStream> shareGenTimeModel;
+    double minShareInterval;
 
     // TCP listening socket
     Ptr<Socket> socket;
@@ -107,18 +320,105 @@ class P2PoolNode : public Application
     // Map of connected peers (nodeID -> socket)
     std::unordered_map<uint32_t, Ptr<Socket>> peerSockets;
 
+    // Bytes received but not yet terminated, and bytes waiting for TCP
+    // buffer space, per socket. Messages are NUL-terminated strings.
+    std::map<Ptr<Socket>, std::string> recvBuffers;
+    std::map<Ptr<Socket>, std::string> sendBuffers;
+
+    // Sync state
+    bool syncRequested;
+    Ptr<Socket> syncSocket;
+    uint32_t syncBatchSize;
+    uint32_t syncExpected;
+    ShareId syncTarget;
+    // main-chain IDs of the HEADERS answers, checked once the shares are in
+    std::vector<ShareId> syncHeaders;
+    uint32_t syncedShares;
+    ns3::Time syncRequestTime;
+    ns3::Time syncCompleteTime;
+    ns3::Time catchUpTime;
+
+    // Validation cost model and queue
+    ns3::Time validationFixedCost;
+    ns3::Time validationPerRefCost;
+    uint32_t validationWorkers;
+    uint32_t busyWorkers;
+    bool validationPriority;
+    struct QueuedShare
+    {
+        Share* share;
+        ns3::Time enqueued;
+    };
+    std::deque<QueuedShare> validationQueue;
+    std::deque<QueuedShare> priorityQueue;
+    LatencySketch queueDelays;
+    size_t maxQueueLength;
+
+    // Miner strategy; a selfish miner's private shares in the order found
+    MinerStrategy minerStrategy;
+    ns3::Time releaseDelay;
+    std::deque<Share*> withheldShares;
+
+    // Work template model (both times zero = always fresh work)
+    ns3::Time templatePushDelay;
+    ns3::Time templateRefreshInterval;
+    WorkTemplate workTemplate;
+    EventId templatePushEvent;
+    EventId templateRefreshEvent;
+    std::vector<ShareId> staleWorkShares;
+    ns3::Time templateAgeSum;
+
+    // Peer rewiring (interval 0 = fixed peers); delivery delays in seconds
+    // behind the first delivery, of the shares first seen this round
+    struct PeerScore
+    {
+        ns3::Time since;
+        std::vector<float> delays;
+    };
+    ns3::Time rewireInterval;
+    uint32_t maxDegree;
+    std::vector<Ipv4Address> peerDirectory;
+    Ptr<UniformRandomVariable> peerPicker;
+    EventId rewireEvent;
+    ns3::Time roundStart;
+    std::unordered_map<ShareId, ns3::Time> roundFirstSeen;
+    std::unordered_map<uint32_t, PeerScore> peerScores;
+    uint32_t peersDropped;
+    uint32_t peersDialled;
+
+    // Churn state: offline nodes and blocked links drop all traffic
+    bool online;
+    std::unordered_set<uint32_t> blockedPeers;
+
     // Event ID for next share generation
     EventId nextShareEvent;
 
-    std::unordered_set<uint32_t> existingShares;
+    std::unordered_set<ShareId> existingShares;
 
     // Running status
     bool running;
     // maximum time_stamp a share can i have for this simulation
     ns3::Time maxTime;
 
+    // Propagation tracker shared by all nodes (may be null)
+    PropagationTracker* propagationTracker;
+
+    // Event log shared by all local nodes (may be null)
+    EventLogWriter* eventLog;
+
+    // Share lifecycle trace sources
+    TracedCallback<const Share*> shareGeneratedTrace;
+    TracedCallback<const Share*> shareReceivedTrace;
+    TracedCallback<const Share*> shareDuplicateTrace;
+    TracedCallback<const Share*> sharePendingTrace;
+    TracedCallback<const Share*> shareConnectedTrace;
+    TracedCallback<ShareId, ShareId> bestTipChangedTrace;
+    TracedCallback<const Share*, uint32_t> shareSentTrace;
+
     // Statistics
     uint32_t sharesCreated;
+    // Sequence number of the next share ID
+    uint32_t shareSequence;
     uint32_t sharesReceived;
     uint32_t sharesSent;
 };
@@ -0,0 +1,33 @@
+#include "ns3chain.h"
+
+#include "chainlog.h"
+
+#include "ns3/log.h"
+
+NS_LOG_COMPONENT_DEFINE("ShareChain");
+
+void InstallShareChainLogging()
+{
+    if (!g_log.IsEnabled(ns3::LOG_ERROR))
+    {
+        SetChainLogHook(ChainLogHook());
+        return;
+    }
+    SetChainLogHook([](ChainLogLevel level, const std::string& message) {
+        switch (level)
+        {
+        case ChainLogLevel::Error:
+            NS_LOG_ERROR(message);
+            break;
+        case ChainLogLevel::Warn:
+            NS_LOG_WARN(message);
+            break;
+        case ChainLogLevel::Info:
+            NS_LOG_INFO(message);
+            break;
+        case ChainLogLevel::Debug:
+            NS_LOG_DEBUG(message);
+            break;
+        }
+    });
+}
@@ -0,0 +1,28 @@
+#ifndef NS3CHAIN_H
+#define NS3CHAIN_H
+
+#include "sharetime.h"
+
+#include "ns3/nstime.h"
+
+/**
+ * Glue between the ns-3 independent share chain core and the simulator.
+ */
+
+inline ShareTime ToShareTime(ns3::Time time)
+{
+    return ShareTime::FromNanoSeconds(time.GetNanoSeconds());
+}
+
+inline ns3::Time ToNs3Time(ShareTime time)
+{
+    return ns3::NanoSeconds(ns3::int64x64_t(time.GetNanoSeconds()));
+}
+
+/**
+ * Routes ShareChain log messages to the ns-3 "ShareChain" log component.
+ * Nothing is installed if that component is fully disabled.
+ */
+void InstallShareChainLogging();
+
+#endif
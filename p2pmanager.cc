@@ -1,5 +1,7 @@
 #include "p2pmanager.h"
 
+#include "profiler.h"
+
 #include "ns3/applications-module.h"
 #include "ns3/config-store-module.h"
 #include "ns3/core-module.h"
@@ -10,11 +12,15 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/random-variable-stream.h"
 
+#include <algorithm>
 #include <cmath>
+#include <filesystem>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <memory>
 #include <random>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -22,6 +28,26 @@ NS_LOG_COMPONENT_DEFINE("P2PManager");
 
 using namespace ns3;
 
+namespace
+{
+// Every std::mt19937 the manager draws from is seeded from the ns-3 seed and
+// run number plus its own offset, so each consumer gets a separate stream
+// and every rank draws the same values.
+enum RngStream
+{
+    TOPOLOGY_STREAM = 0,
+    HASH_POWER_STREAM = 1,
+    CHURN_STREAM = 2,
+    UPLINK_STREAM = 3,
+    REGION_STREAM = 4
+};
+
+uint32_t StreamSeed(RngStream stream)
+{
+    return RngSeedManager::GetSeed() * 1000003u + RngSeedManager::GetRun() + stream;
+}
+}
+
 P2PManager::P2PManager(uint32_t numNodes,
                        double shareGenMean,
                        double shareGenVariance,
@@ -33,22 +59,335 @@ P2PManager::P2PManager(uint32_t numNodes,
       shareGenVariance(shareGenVariance),
       maxTipsToReference(maxTipsToReference),
       simulationDuration(simulationDuration),
-      maxTime(maxTimeStamp)
+      maxTime(maxTimeStamp),
+      propagationExpiry(Seconds(60)),
+      retargetWindow(0),
+      targetInterval(shareGenMean),
+      payoutWindow(0),
+      uncleWeight(1.0),
+      validationWorkers(1),
+      validationPriority(false),
+      lateJoiners(0),
+      syncBatchSize(500),
+      lateNodesJoined(false),
+      churnRate(0),
+      churnDowntime(0),
+      convergenceCheckPending(false),
+      agreementSamples(0),
+      agreementLagSum(0),
+      agreementLagMax(0),
+      linkDataRate("5Mbps"),
+      regionJitterMs(0),
+      uplinkDistribution("fixed"),
+      uplinkMedianMbps(20),
+      uplinkSigma(0.8),
+      rewireMaxDegree(0),
+      arrivalModel(NORMAL_ARRIVALS),
+      hashPowerDistribution("legacy"),
+      paretoShape(1.5),
+      systemId(0),
+      systemCount(1)
 {
-    nodes.Create(numNodes);
-    internet.Install(nodes);
+#ifdef NS3_MPI
+    if (MpiInterface::IsEnabled())
+    {
+        systemId = MpiInterface::GetSystemId();
+        systemCount = MpiInterface::GetSize();
+    }
+#endif
     addressHelper.SetBase("10.1.0.0", "255.255.255.0");
+    minerStrategies.assign(numNodes, P2PoolNode::HONEST_MINER);
+    // the chain log hook is process-wide; every node's chain shares it
+    InstallShareChainLogging();
     NS_LOG_FUNCTION(this << numNodes << shareGenMean << shareGenVariance << maxTipsToReference
                          << simulationDuration);
-    LogComponentEnable("P2PManager", LOG_LEVEL_INFO);
 }
 
     
+void P2PManager::ConfigureMining(const std::string& arrivalModelName,
+                                 const std::string& distribution,
+                                 double shape)
+    {
+        if (arrivalModelName == "normal")
+        {
+            arrivalModel = NORMAL_ARRIVALS;
+        }
+        else if (arrivalModelName == "exponential")
+        {
+            arrivalModel = EXPONENTIAL_ARRIVALS;
+        }
+        else if (arrivalModelName == "superposed")
+        {
+            arrivalModel = SUPERPOSED_ARRIVALS;
+        }
+        else
+        {
+            NS_FATAL_ERROR("Unknown share arrival model " << arrivalModelName);
+        }
+        hashPowerDistribution = distribution;
+        paretoShape = shape;
+    }
+
+void P2PManager::SetDifficultyRetarget(uint32_t window, double interval)
+    {
+        retargetWindow = window;
+        targetInterval = interval;
+    }
+
+void P2PManager::SetPayoutWindow(uint32_t window, double weight)
+    {
+        payoutWindow = window;
+        uncleWeight = weight;
+    }
+
+void P2PManager::SetPropagationExpiry(Time expiry)
+    {
+        NS_ABORT_MSG_IF(!expiry.IsStrictlyPositive(), "The propagation expiry must be positive");
+        propagationExpiry = expiry;
+    }
+
+void P2PManager::SetValidationCost(Time fixedCost, Time perRefCost, uint32_t workers, bool priority)
+    {
+        validationFixedCost = fixedCost;
+        validationPerRefCost = perRefCost;
+        validationWorkers = workers;
+        validationPriority = priority;
+    }
+
+void P2PManager::SetLateJoiners(uint32_t count, Time time, uint32_t batchSize)
+    {
+        NS_ABORT_MSG_IF(count >= numNodes, "At least one node has to start the network");
+        NS_ABORT_MSG_IF(count > 0 && time <= Seconds(5),
+                        "Late nodes must join after the connection setup at 5 s");
+        lateJoiners = count;
+        joinTime = time;
+        syncBatchSize = batchSize;
+    }
+
+void P2PManager::SetMinerStrategies(const std::string& spec, Time delay)
+    {
+        releaseDelay = delay;
+        std::istringstream entries(spec);
+        std::string entry;
+        while (std::getline(entries, entry, ','))
+        {
+            size_t colon = entry.find(':');
+            NS_ABORT_MSG_IF(colon == std::string::npos,
+                            "Miner strategy " << entry << " is not <node>:<strategy>");
+            uint32_t node = std::stoul(entry.substr(0, colon));
+            std::string strategy = entry.substr(colon + 1);
+            NS_ABORT_MSG_IF(node >= numNodes, "Miner strategy for unknown node " << node);
+            if (strategy == "honest")
+            {
+                minerStrategies[node] = P2PoolNode::HONEST_MINER;
+            }
+            else if (strategy == "selfish")
+            {
+                minerStrategies[node] = P2PoolNode::SELFISH_MINER;
+            }
+            else if (strategy == "delay")
+            {
+                minerStrategies[node] = P2PoolNode::DELAYED_MINER;
+            }
+            else
+            {
+                NS_FATAL_ERROR("Unknown miner strategy " << strategy);
+            }
+        }
+    }
+
+void P2PManager::SetWorkTemplate(Time pushDelay, Time refreshInterval)
+    {
+        templatePushDelay = pushDelay;
+        templateRefreshInterval = refreshInterval;
+    }
+
+void P2PManager::SetLinkDataRate(const std::string& rate)
+    {
+        linkDataRate = rate;
+    }
+
+void P2PManager::SetRegions(const std::string& model, double jitterMs)
+    {
+        regionNames.clear();
+        regionWeights.clear();
+        regionRtt.clear();
+        regionJitterMs = jitterMs;
+        if (model == "none")
+        {
+            return;
+        }
+        if (model == "world")
+        {
+            // Rough node shares of public pools and RTTs between continents
+            regionNames = {"namerica", "europe", "asia", "samerica", "oceania"};
+            regionWeights = {0.30, 0.30, 0.25, 0.08, 0.07};
+            regionRtt = {{40, 90, 160, 130, 160},
+                         {90, 25, 220, 190, 270},
+                         {160, 220, 50, 300, 120},
+                         {130, 190, 300, 40, 300},
+                         {160, 270, 120, 300, 30}};
+        }
+        else if (model.rfind("file:", 0) == 0)
+        {
+            std::string path = model.substr(5);
+            std::ifstream in(path);
+            NS_ABORT_MSG_UNLESS(in.is_open(), "Cannot open region file " << path);
+            std::string line;
+            while (std::getline(in, line))
+            {
+                std::istringstream fields(line);
+                std::string name;
+                double weight;
+                if (!(fields >> name) || name[0] == '#')
+                {
+                    continue;
+                }
+                NS_ABORT_MSG_UNLESS(fields >> weight && weight >= 0,
+                                    "Region " << name << " in " << path << " needs a weight");
+                std::vector<double> rtt;
+                double value;
+                while (fields >> value)
+                {
+                    rtt.push_back(value);
+                }
+                regionNames.push_back(name);
+                regionWeights.push_back(weight);
+                regionRtt.push_back(rtt);
+            }
+            NS_ABORT_MSG_IF(regionNames.empty(), "Region file " << path << " has no regions");
+            for (size_t r = 0; r < regionNames.size(); ++r)
+            {
+                NS_ABORT_MSG_UNLESS(regionRtt[r].size() == regionNames.size(),
+                                    "Region " << regionNames[r] << " in " << path << " needs "
+                                              << regionNames.size() << " RTTs");
+            }
+        }
+        else
+        {
+            NS_FATAL_ERROR("Unknown region model " << model);
+        }
+    }
+
+void P2PManager::SetAccessBandwidth(const std::string& distribution, double medianMbps, double sigma)
+    {
+        uplinkDistribution = distribution;
+        uplinkMedianMbps = medianMbps;
+        uplinkSigma = sigma;
+    }
+
+void P2PManager::AssignRegions()
+    {
+        nodeRegion.clear();
+        if (regionNames.empty())
+        {
+            return;
+        }
+        std::mt19937 rng(StreamSeed(REGION_STREAM));
+        std::discrete_distribution<uint32_t> region(regionWeights.begin(), regionWeights.end());
+        std::uniform_real_distribution<double> jitter(0.0, regionJitterMs);
+        nodeRegion.resize(numNodes);
+        for (uint32_t i = 0; i < numNodes; ++i)
+        {
+            nodeRegion[i] = region(rng);
+        }
+        for (auto& link : links)
+        {
+            uint32_t a = nodeRegion[link.a];
+            uint32_t b = nodeRegion[link.b];
+            double rtt = (regionRtt[a][b] + regionRtt[b][a]) / 2;
+            link.latencyMs = rtt / 2 + jitter(rng);
+        }
+    }
+
+void P2PManager::AssignUplinks()
+    {
+        nodeUplink.clear();
+        if (uplinkDistribution == "fixed")
+        {
+            return;
+        }
+        nodeUplink.assign(numNodes, 0.0);
+        std::mt19937 rng(StreamSeed(UPLINK_STREAM));
+        if (uplinkDistribution == "lognormal")
+        {
+            std::lognormal_distribution<double> mbps(std::log(uplinkMedianMbps), uplinkSigma);
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                // a floor keeps the tail of the distribution able to send a share
+                nodeUplink[i] = std::max(mbps(rng), 0.1) * 1e6;
+            }
+        }
+        else if (uplinkDistribution.rfind("file:", 0) == 0)
+        {
+            std::string path = uplinkDistribution.substr(5);
+            std::ifstream in(path);
+            NS_ABORT_MSG_UNLESS(in.is_open(), "Cannot open uplink file " << path);
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                NS_ABORT_MSG_UNLESS(in >> nodeUplink[i] && nodeUplink[i] > 0,
+                                    "Uplink file " << path << " needs " << numNodes
+                                                   << " positive rates");
+                nodeUplink[i] *= 1e6;
+            }
+        }
+        else
+        {
+            NS_FATAL_ERROR("Unknown uplink distribution " << uplinkDistribution);
+        }
+    }
+
+void P2PManager::AssignHashPower()
+    {
+        hashPower.assign(numNodes, 1.0);
+        std::mt19937 rng(StreamSeed(HASH_POWER_STREAM));
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+        if (hashPowerDistribution == "legacy")
+        {
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                hashPower[i] = 0.5 + ((i * 7919) % 100) / 100.0;
+            }
+        }
+        else if (hashPowerDistribution == "uniform")
+        {
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                hashPower[i] = 0.5 + unit(rng);
+            }
+        }
+        else if (hashPowerDistribution == "pareto")
+        {
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                hashPower[i] = 1.0 / std::pow(1.0 - unit(rng), 1.0 / paretoShape);
+            }
+        }
+        else if (hashPowerDistribution.rfind("file:", 0) == 0)
+        {
+            std::string path = hashPowerDistribution.substr(5);
+            std::ifstream in(path);
+            NS_ABORT_MSG_UNLESS(in.is_open(), "Cannot open hash power file " << path);
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                NS_ABORT_MSG_UNLESS(in >> hashPower[i] && hashPower[i] > 0,
+                                    "Hash power file " << path << " needs " << numNodes
+                                                       << " positive values");
+            }
+        }
+        else
+        {
+            NS_FATAL_ERROR("Unknown hash power distribution " << hashPowerDistribution);
+        }
+    }
+
 void P2PManager::CreateRandomTopology(double connectionProbability, double latency)
     {
         NS_LOG_FUNCTION(this);
-        std::random_device rd;
-        std::mt19937 rng(rd());
+        // Every rank has to draw the same topology, so the generator is
+        // seeded from the ns-3 seed and run number instead of random_device.
+        std::mt19937 rng(StreamSeed(TOPOLOGY_STREAM));
         std::uniform_real_distribution<double> dist(0.0, 1.0);
         for (uint32_t i = 0; i < numNodes; i++)
         {
@@ -58,7 +397,7 @@ void P2PManager::CreateRandomTopology(double connectionProbability, double laten
                 if (dist(rng) < connectionProbability)
                 {
                     connected = true;
-                    ConnectNodes(i, j, latency);
+                    links.push_back({i, j, latency});
                 }
             }
 
@@ -66,31 +405,195 @@ void P2PManager::CreateRandomTopology(double connectionProbability, double laten
             {
                 if (i == 0 && numNodes > 0)
                 {
-                    ConnectNodes(0, 1, latency);
+                    links.push_back({0, 1, latency});
                 }
                 else
                 {
-                    ConnectNodes(i, i - 1, latency);
+                    links.push_back({i, i - 1, latency});
                 }
             }
         }
 
+        // Link delays have to be final before the partitioner weighs them
+        AssignRegions();
+        AssignUplinks();
+
+        nodeSystemId = PartitionNodes(systemCount);
+        for (uint32_t i = 0; i < numNodes; ++i)
+        {
+            nodes.Add(CreateObject<Node>(nodeSystemId[i]));
+        }
+        internet.Install(nodes);
+
+        nodeAddresses.assign(numNodes, Ipv4Address());
+        for (const auto& link : links)
+        {
+            ConnectNodes(link.a, link.b, link.latencyMs);
+        }
+
+        // A rank only sees the arrivals at its own nodes, so propagation
+        // coverage is only tracked when the whole network is in one process.
+        if (systemCount == 1)
+        {
+            propagationTracker = std::make_unique<PropagationTracker>(numNodes, propagationExpiry);
+            if (!regionNames.empty())
+            {
+                propagationTracker->SetRegions(nodeRegion, regionNames);
+            }
+            Simulator::Schedule(PropagationCheckInterval(), &P2PManager::ExpirePropagation, this);
+        }
+
+        AssignHashPower();
+        nodeOnline.assign(numNodes, true);
+        double minShareInterval = arrivalModel == NORMAL_ARRIVALS ? 0.1 : 0.0;
+        p2pNodes.assign(numNodes, nullptr);
         for (uint32_t i = 0; i < numNodes; ++i)
         {
-            Ptr<NormalRandomVariable> shareGenModel = CreateShareGenTimeModel(i);
-            Ptr<P2PoolNode> p2pNode = Create<P2PoolNode>(i, shareGenModel, maxTipsToReference, maxTime);
+            if (!IsLocalNode(i))
+            {
+                continue;
+            }
+            Ptr<RandomVariableStream> shareGenModel = CreateShareGenTimeModel(i);
+            Ptr<P2PoolNode> p2pNode =
+                Create<P2PoolNode>(i, shareGenModel, maxTipsToReference, maxTime, minShareInterval);
             nodes.Get(i)->AddApplication(p2pNode);
             p2pNode->SetStartTime(Seconds(0.0));
             p2pNode->SetStopTime(Seconds(simulationDuration + 1.0));
-            p2pNodes.push_back(p2pNode);
+            p2pNode->SetPropagationTracker(propagationTracker.get());
+            p2pNode->GetShareChain()->setRetargetWindow(retargetWindow, targetInterval);
+            p2pNode->GetShareChain()->setPayoutWindow(payoutWindow, uncleWeight);
+            p2pNode->SetSyncBatchSize(syncBatchSize);
+            p2pNode->SetMinerStrategy(minerStrategies[i], releaseDelay);
+            p2pNode->SetWorkTemplate(templatePushDelay, templateRefreshInterval);
+            p2pNode->SetValidationCost(validationFixedCost, validationPerRefCost, validationWorkers,
+                                       validationPriority);
+            p2pNodes[i] = p2pNode;
         }
         Ipv4GlobalRoutingHelper::PopulateRoutingTables();
 
         Simulator::Schedule(Seconds(5) + Simulator::Now(), &P2PManager::makeconnections, this);
+        if (lateJoiners > 0)
+        {
+            Simulator::Schedule(joinTime, &P2PManager::JoinLateNodes, this);
+        }
 
         NS_LOG_INFO("Network configured with " << latency << " lactency");
     }
 
+bool P2PManager::IsLocalNode(uint32_t i) const
+    {
+        return nodeSystemId[i] == systemId;
+    }
+
+bool P2PManager::IsWaitingToJoin(uint32_t i) const
+    {
+        return !lateNodesJoined && i >= numNodes - lateJoiners;
+    }
+
+std::vector<uint32_t> P2PManager::PartitionNodes(uint32_t numRanks) const
+    {
+        std::vector<uint32_t> part(numNodes, 0);
+        if (numRanks <= 1)
+        {
+            return part;
+        }
+
+        // Affinity of a link is its inverse latency: keeping fast links
+        // inside a rank leaves only slow links to cross ranks.
+        std::vector<std::vector<std::pair<uint32_t, double>>> adj(numNodes);
+        for (const auto& link : links)
+        {
+            double affinity = 1.0 / std::max(link.latencyMs, 1e-3);
+            adj[link.a].push_back({link.b, affinity});
+            adj[link.b].push_back({link.a, affinity});
+        }
+
+        // Greedy region growing: each rank absorbs the unassigned node with
+        // the strongest affinity to it until it holds its share of nodes.
+        const uint32_t unassigned = std::numeric_limits<uint32_t>::max();
+        std::fill(part.begin(), part.end(), unassigned);
+        std::vector<uint32_t> partSize(numRanks, 0);
+        uint32_t remaining = numNodes;
+        for (uint32_t p = 0; p < numRanks; ++p)
+        {
+            uint32_t target = (remaining + (numRanks - p) - 1) / (numRanks - p);
+            std::vector<double> gain(numNodes, 0.0);
+            while (partSize[p] < target)
+            {
+                uint32_t best = unassigned;
+                for (uint32_t v = 0; v < numNodes; ++v)
+                {
+                    if (part[v] == unassigned && (best == unassigned || gain[v] > gain[best]))
+                    {
+                        best = v;
+                    }
+                }
+                part[best] = p;
+                partSize[p]++;
+                remaining--;
+                for (const auto& edge : adj[best])
+                {
+                    if (part[edge.first] == unassigned)
+                    {
+                        gain[edge.first] += edge.second;
+                    }
+                }
+            }
+        }
+
+        // Refinement: move a node to the rank it is most attached to as long
+        // as neither rank drifts more than one node from its balanced size.
+        const uint32_t maxSize = (numNodes + numRanks - 1) / numRanks + 1;
+        const uint32_t minSize = numNodes / numRanks > 0 ? numNodes / numRanks - 1 : 0;
+        for (int pass = 0; pass < 4; ++pass)
+        {
+            bool moved = false;
+            for (uint32_t v = 0; v < numNodes; ++v)
+            {
+                std::vector<double> affinity(numRanks, 0.0);
+                for (const auto& edge : adj[v])
+                {
+                    affinity[part[edge.first]] += edge.second;
+                }
+                uint32_t own = part[v];
+                uint32_t bestPart = own;
+                for (uint32_t p = 0; p < numRanks; ++p)
+                {
+                    if (affinity[p] > affinity[bestPart] && partSize[p] < maxSize)
+                    {
+                        bestPart = p;
+                    }
+                }
+                if (bestPart != own && partSize[own] > minSize)
+                {
+                    part[v] = bestPart;
+                    partSize[own]--;
+                    partSize[bestPart]++;
+                    moved = true;
+                }
+            }
+            if (!moved)
+            {
+                break;
+            }
+        }
+
+        uint32_t cutLinks = 0;
+        double lookaheadMs = std::numeric_limits<double>::infinity();
+        for (const auto& link : links)
+        {
+            if (part[link.a] != part[link.b])
+            {
+                cutLinks++;
+                lookaheadMs = std::min(lookaheadMs, link.latencyMs);
+            }
+        }
+        NS_LOG_INFO("Partitioned " << numNodes << " nodes over " << numRanks << " ranks: "
+                                   << cutLinks << " of " << links.size()
+                                   << " links cut, lookahead " << lookaheadMs << " ms");
+        return part;
+    }
+
     
 void P2PManager::makeconnections()
     {
@@ -98,96 +601,1396 @@ void P2PManager::makeconnections()
         {
             uint32_t i = connection.first.first;
             uint32_t j = connection.first.second;
-            ConnectPeerSockets(i, j);
+            if (IsLocalNode(i) && !IsWaitingToJoin(i) && !IsWaitingToJoin(j))
+            {
+                // node work runs in the node's context, and so in its own MTP
+                // partition, like the shares of GenerateNetworkShare
+                Simulator::ScheduleWithContext(nodes.Get(i)->GetId(), Seconds(0),
+                                               &P2PManager::ConnectPeerSockets, this, i, j);
+            }
         }
         startGeneratingShares();
     }
 
-   
-void P2PManager::startGeneratingShares()
+void P2PManager::JoinLateNodes()
     {
-        for (auto& node : p2pNodes)
+        for (const auto& connection : connections)
+        {
+            uint32_t i = connection.first.first;
+            uint32_t j = connection.first.second;
+            if (IsLocalNode(i) && (IsWaitingToJoin(i) || IsWaitingToJoin(j)))
+            {
+                Simulator::ScheduleWithContext(nodes.Get(i)->GetId(), Seconds(0),
+                                               &P2PManager::ConnectPeerSockets, this, i, j);
+            }
+        }
+        for (uint32_t i = numNodes - lateJoiners; i < numNodes; ++i)
         {
-            node->ScheduleNextShareGeneration();
+            if (!p2pNodes[i])
+            {
+                continue;
+            }
+            NS_LOG_INFO("Node " << i << " joins the network");
+            uint32_t context = nodes.Get(i)->GetId();
+            Simulator::ScheduleWithContext(context, Seconds(0), &P2PoolNode::RequestSync, p2pNodes[i]);
+            if (arrivalModel != SUPERPOSED_ARRIVALS)
+            {
+                Simulator::ScheduleWithContext(context, Seconds(0),
+                                               &P2PoolNode::ScheduleNextShareGeneration, p2pNodes[i]);
+            }
         }
+        lateNodesJoined = true;
     }
 
-    
-void P2PManager::ConnectNodes(uint32_t i, uint32_t j, double latencyMs)
+   
+void P2PManager::startGeneratingShares()
     {
-        PointToPointHelper p2pHelper;
-        p2pHelper.SetDeviceAttribute("DataRate", StringValue("5Mbps"));
-        p2pHelper.SetChannelAttribute("Delay", TimeValue(MilliSeconds(latencyMs)));
-
-        NodeContainer linkNodes;
-        linkNodes.Add(nodes.Get(i));
-        linkNodes.Add(nodes.Get(j));
-
-        NetDeviceContainer linkDevices = p2pHelper.Install(linkNodes);
-
-        Ipv4InterfaceContainer ifc = addressHelper.Assign(linkDevices);
-        addressHelper.NewNetwork();
-
-        ConnectionInfo connInfo;
-        connInfo.devices = linkDevices;
-        connInfo.channel = linkDevices.Get(0)->GetChannel()->GetObject<PointToPointChannel>();
-        connInfo.ifc = ifc;
+        if (arrivalModel == SUPERPOSED_ARRIVALS)
+        {
+            // Node i alone would find shares at rate hashPower[i] / meanPower
+            // / shareGenMean, so the network keeps numNodes / shareGenMean.
+            double meanPower = 0;
+            for (double power : hashPower)
+            {
+                meanPower += power / numNodes;
+            }
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                if (p2pNodes[i])
+                {
+                    localMiners.push_back(i);
+                    minerRate.push_back(hashPower[i] / meanPower / shareGenMean);
+                }
+            }
+            if (localMiners.empty())
+            {
+                return;
+            }
+            cumulativeMinerRate.resize(localMiners.size());
+            // unit mean and range, scaled by the total rate of each draw
+            networkShareInterval = CreateObject<ExponentialRandomVariable>();
+            networkShareInterval->SetAttribute("Mean", DoubleValue(1.0));
+            minerSelector = CreateObject<UniformRandomVariable>();
+            minerSelector->SetAttribute("Max", DoubleValue(1.0));
+            ScheduleNextNetworkShare();
+            return;
+        }
 
-        connections[std::make_pair(i, j)] = connInfo;
+        for (uint32_t i = 0; i < numNodes; ++i)
+        {
+            if (p2pNodes[i] && !IsWaitingToJoin(i))
+            {
+                Simulator::ScheduleWithContext(nodes.Get(i)->GetId(), Seconds(0),
+                                               &P2PoolNode::ScheduleNextShareGeneration, p2pNodes[i]);
+            }
+        }
     }
 
     
-void P2PManager::ConnectPeerSockets(uint32_t i, uint32_t j)
+void P2PManager::ScheduleNextNetworkShare()
     {
-        auto& conn = connections[{i, j}];
-        Ipv4Address addrJ = conn.ifc.GetAddress(1);
-
-        Ptr<Socket> socket = Socket::CreateSocket(nodes.Get(i), TcpSocketFactory::GetTypeId());
-
-        socket->Connect(InetSocketAddress(addrJ, j + 1000));
-
-        socket->SetRecvCallback(MakeCallback(&P2PoolNode::HandleReceivedShare, p2pNodes[i]));
-        NS_LOG_INFO("connection " << i << ' ' << j << ' ' << addrJ);
-        p2pNodes[i]->AddPeerSocket(j, socket);
-        std::string reg = "REGISTER:" + std::to_string(i);
-        Ptr<Packet> packet =
-            Create<Packet>(reinterpret_cast<const uint8_t*>(reg.c_str()), reg.length() + 1);
-        socket->Send(packet);
+        // A miner at difficulty d finds shares at its base rate / d; the rates
+        // change with every retarget, so they are summed again for each share
+        double totalRate = 0;
+        for (size_t k = 0; k < localMiners.size(); ++k)
+        {
+            totalRate += minerRate[k] / p2pNodes[localMiners[k]]->GetWorkDifficulty();
+            cumulativeMinerRate[k] = totalRate;
+        }
+        double pick = minerSelector->GetValue() * totalRate;
+        size_t index = std::upper_bound(cumulativeMinerRate.begin(), cumulativeMinerRate.end(), pick) -
+                       cumulativeMinerRate.begin();
+        uint32_t miner = localMiners[std::min(index, localMiners.size() - 1)];
+        Simulator::Schedule(Seconds(networkShareInterval->GetValue() / totalRate),
+                            &P2PManager::GenerateNetworkShare,
+                            this,
+                            miner,
+                            p2pNodes[miner]->GetWorkDifficulty());
     }
 
-    
-void P2PManager::Run()
+void P2PManager::GenerateNetworkShare(uint32_t miner, double difficulty)
     {
-        NS_LOG_FUNCTION(this);
-
-        NS_LOG_INFO("Starting simulation for " << simulationDuration << " seconds");
-        Simulator::Stop(Seconds(simulationDuration));
-        Simulator::Run();
-        Simulator::Destroy();
-        NS_LOG_INFO("Simulation completed");
+        if (IsWaitingToJoin(miner) || !nodeOnline[miner])
+        {
+            // an offline miner's hash power is lost until it joins
+            ScheduleNextNetworkShare();
+            return;
+        }
+        // run the share in the miner's context, as its own events would be
+        Simulator::ScheduleWithContext(nodes.Get(miner)->GetId(),
+                                       Seconds(0),
+                                       &P2PoolNode::GenerateAndBroadcastShare,
+                                       p2pNodes[miner],
+                                       difficulty);
+        ScheduleNextNetworkShare();
     }
 
-    
+void P2PManager::LoadChurnScenario(const std::string& path)
+    {
+        std::ifstream in(path);
+        NS_ABORT_MSG_UNLESS(in.is_open(), "Cannot open churn scenario " << path);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            double at;
+            std::string event;
+            if (!(fields >> at >> event))
+            {
+                continue;
+            }
+            uint32_t a = 0;
+            uint32_t b = 0;
+            if (event == "leave" || event == "join")
+            {
+                NS_ABORT_MSG_UNLESS(fields >> a && a < numNodes, "Bad churn event: " << line);
+                Simulator::Schedule(Seconds(at), &P2PManager::SetNodeOnline, this, a,
+                                    event == "join", event + " node " + std::to_string(a));
+            }
+            else if (event == "linkdown" || event == "linkup")
+            {
+                NS_ABORT_MSG_UNLESS(fields >> a >> b && a < numNodes && b < numNodes,
+                                    "Bad churn event: " << line);
+                Simulator::Schedule(Seconds(at), &P2PManager::SetLinkDown, this, a, b,
+                                    event == "linkdown");
+            }
+            else if (event == "partition")
+            {
+                std::string list;
+                fields >> list;
+                std::vector<uint32_t> side;
+                std::istringstream ids(list);
+                std::string id;
+                while (std::getline(ids, id, ','))
+                {
+                    side.push_back(std::stoul(id));
+                    NS_ABORT_MSG_UNLESS(side.back() < numNodes, "Bad churn event: " << line);
+                }
+                Simulator::Schedule(Seconds(at), &P2PManager::Partition, this, side);
+            }
+            else if (event == "heal")
+            {
+                Simulator::Schedule(Seconds(at), &P2PManager::Heal, this);
+            }
+            else
+            {
+                NS_FATAL_ERROR("Unknown churn event " << event << " in " << path);
+            }
+        }
+    }
+
+void P2PManager::EnableRandomChurn(double leaveRate, double meanDowntime)
+    {
+        if (leaveRate <= 0)
+        {
+            return;
+        }
+        churnRate = leaveRate;
+        churnDowntime = meanDowntime;
+        churnRng.seed(StreamSeed(CHURN_STREAM));
+        ScheduleNextChurn();
+    }
+
+void P2PManager::EnableConvergenceTracking(Time interval)
+    {
+        if (systemCount > 1)
+        {
+            NS_LOG_WARN("Convergence tracking needs all nodes in one process; disabled");
+            return;
+        }
+        convergenceInterval = interval;
+    }
+
+void P2PManager::SetNodeOnline(uint32_t node, bool online, const std::string& reason)
+    {
+        if (nodeOnline[node] == online || IsWaitingToJoin(node))
+        {
+            return;
+        }
+        nodeOnline[node] = online;
+        if (IsLocalNode(node))
+        {
+            // the node closes sockets and sends messages, so it runs in its own context
+            Simulator::ScheduleWithContext(nodes.Get(node)->GetId(), Seconds(0),
+                                           online ? &P2PoolNode::GoOnline : &P2PoolNode::GoOffline,
+                                           p2pNodes[node]);
+        }
+        RecordDisruption(reason);
+    }
+
+void P2PManager::SetLinkDown(uint32_t a, uint32_t b, bool down)
+    {
+        auto link = std::minmax(a, b);
+        if (down)
+        {
+            downLinks.insert(link);
+        }
+        else
+        {
+            downLinks.erase(link);
+        }
+        ApplyLinkState(link.first, link.second);
+        RecordDisruption(std::string(down ? "linkdown " : "linkup ") + std::to_string(link.first) +
+                         "-" + std::to_string(link.second));
+    }
+
+void P2PManager::Partition(const std::vector<uint32_t>& side)
+    {
+        std::vector<bool> inSide(numNodes, false);
+        for (uint32_t node : side)
+        {
+            inSide[node] = true;
+        }
+        if (rewireInterval.IsStrictlyPositive())
+        {
+            // rewired peers may be any pair of nodes, not only linked ones
+            for (uint32_t a = 0; a < numNodes; ++a)
+            {
+                for (uint32_t b = a + 1; b < numNodes; ++b)
+                {
+                    if (inSide[a] != inSide[b])
+                    {
+                        partitionedLinks.insert({a, b});
+                        ApplyLinkState(a, b);
+                    }
+                }
+            }
+        }
+        else
+        {
+            for (const auto& link : links)
+            {
+                if (inSide[link.a] != inSide[link.b])
+                {
+                    partitionedLinks.insert(std::minmax(link.a, link.b));
+                    ApplyLinkState(link.a, link.b);
+                }
+            }
+        }
+        RecordDisruption("partition of " + std::to_string(side.size()) + " nodes");
+    }
+
+void P2PManager::Heal()
+    {
+        std::set<std::pair<uint32_t, uint32_t>> healed;
+        healed.swap(partitionedLinks);
+        for (const auto& link : healed)
+        {
+            ApplyLinkState(link.first, link.second);
+        }
+        RecordDisruption("heal");
+    }
+
+void P2PManager::ApplyLinkState(uint32_t a, uint32_t b)
+    {
+        auto link = std::minmax(a, b);
+        bool blocked = downLinks.count(link) || partitionedLinks.count(link);
+        if (IsLocalNode(a) && p2pNodes[a])
+        {
+            Simulator::ScheduleWithContext(nodes.Get(a)->GetId(), Seconds(0),
+                                           &P2PoolNode::SetPeerBlocked, p2pNodes[a], b, blocked);
+        }
+        if (IsLocalNode(b) && p2pNodes[b])
+        {
+            Simulator::ScheduleWithContext(nodes.Get(b)->GetId(), Seconds(0),
+                                           &P2PoolNode::SetPeerBlocked, p2pNodes[b], a, blocked);
+        }
+    }
+
+void P2PManager::ScheduleNextChurn()
+    {
+        std::exponential_distribution<double> gap(churnRate);
+        Simulator::Schedule(Seconds(gap(churnRng)), &P2PManager::ChurnNode, this);
+    }
+
+void P2PManager::ChurnNode()
+    {
+        std::vector<uint32_t> candidates;
+        for (uint32_t i = 0; i < numNodes; ++i)
+        {
+            if (nodeOnline[i] && !IsWaitingToJoin(i))
+            {
+                candidates.push_back(i);
+            }
+        }
+        // keep at least one node mining
+        if (candidates.size() > 1)
+        {
+            uint32_t node = candidates[churnRng() % candidates.size()];
+            std::exponential_distribution<double> downtime(1.0 / churnDowntime);
+            SetNodeOnline(node, false, "leave node " + std::to_string(node));
+            Simulator::Schedule(Seconds(downtime(churnRng)), &P2PManager::SetNodeOnline, this, node,
+                                true, "join node " + std::to_string(node));
+        }
+        ScheduleNextChurn();
+    }
+
+void P2PManager::RecordDisruption(const std::string& description)
+    {
+        NS_LOG_INFO("Disruption at " << Simulator::Now().GetSeconds() << "s: " << description);
+        if (convergenceInterval.IsZero())
+        {
+            return;
+        }
+        disruptions.push_back({Simulator::Now(), description, Time(), false});
+        if (!convergenceCheckPending)
+        {
+            convergenceCheckPending = true;
+            Simulator::Schedule(convergenceInterval, &P2PManager::CheckConvergence, this);
+        }
+    }
+
+void P2PManager::CheckConvergence()
+    {
+        convergenceCheckPending = false;
+        bool agree = true;
+        bool first = true;
+        ShareId tip = 0;
+        for (uint32_t i = 0; i < numNodes && agree; ++i)
+        {
+            if (!nodeOnline[i] || IsWaitingToJoin(i))
+            {
+                continue;
+            }
+            ShareId nodeTip = p2pNodes[i]->GetShareChain()->getBestTip();
+            agree = first || nodeTip == tip;
+            tip = nodeTip;
+            first = false;
+        }
+
+        bool open = false;
+        for (Disruption& disruption : disruptions)
+        {
+            if (!disruption.converged && agree)
+            {
+                disruption.converged = true;
+                disruption.convergedAt = Simulator::Now();
+            }
+            open = open || !disruption.converged;
+        }
+        if (open && Simulator::Now() < Seconds(simulationDuration))
+        {
+            convergenceCheckPending = true;
+            Simulator::Schedule(convergenceInterval, &P2PManager::CheckConvergence, this);
+        }
+    }
+
+void P2PManager::PrintDisruptions() const
+    {
+        if (disruptions.empty())
+        {
+            return;
+        }
+        std::cout << "=== Disruptions and best-tip convergence ===" << std::endl;
+        double total = 0;
+        uint32_t converged = 0;
+        for (const Disruption& disruption : disruptions)
+        {
+            std::cout << disruption.at.GetSeconds() << "s " << disruption.description << ": ";
+            if (disruption.converged)
+            {
+                double seconds = (disruption.convergedAt - disruption.at).GetSeconds();
+                std::cout << "tips agree after " << seconds << "s" << std::endl;
+                total += seconds;
+                converged++;
+            }
+            else
+            {
+                std::cout << "tips did not agree again" << std::endl;
+            }
+        }
+        if (converged > 0)
+        {
+            std::cout << "Mean convergence time: " << total / converged << "s (" << converged << "/"
+                      << disruptions.size() << " disruptions)" << std::endl;
+        }
+    }
+
+void P2PManager::EnableAgreementSampling(Time interval, const std::string& path)
+    {
+        if (!interval.IsStrictlyPositive())
+        {
+            return;
+        }
+        if (systemCount > 1)
+        {
+            NS_LOG_WARN("Agreement sampling needs all nodes in one process; disabled");
+            return;
+        }
+        std::filesystem::path parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty())
+        {
+            std::filesystem::create_directories(parent);
+        }
+        agreementSeries.open(path);
+        if (!agreementSeries.is_open())
+        {
+            NS_LOG_ERROR("Failed to open agreement file " << path);
+            return;
+        }
+        agreementSeries << "time,agreedHeight,minHeight,maxHeight" << std::endl;
+        agreementInterval = interval;
+        Simulator::Schedule(agreementInterval, &P2PManager::SampleAgreement, this);
+    }
+
+Time P2PManager::PropagationCheckInterval() const
+    {
+        // shares are folded at most a quarter of the expiry late
+        return Seconds(propagationExpiry.GetSeconds() / 4);
+    }
+
+void P2PManager::ExpirePropagation()
+    {
+        propagationTracker->ExpireShares(Simulator::Now());
+        if (Simulator::Now() + PropagationCheckInterval() <= Seconds(simulationDuration))
+        {
+            Simulator::Schedule(PropagationCheckInterval(), &P2PManager::ExpirePropagation, this);
+        }
+    }
+
+uint32_t P2PManager::FindAgreedHeight(uint32_t& minHeight, uint32_t& maxHeight) const
+    {
+        std::vector<ShareChain*> chains;
+        minHeight = std::numeric_limits<uint32_t>::max();
+        maxHeight = 0;
+        for (uint32_t i = 0; i < numNodes; ++i)
+        {
+            if (!nodeOnline[i] || IsWaitingToJoin(i))
+            {
+                continue;
+            }
+            ShareChain* chain = p2pNodes[i]->GetShareChain();
+            uint32_t height = chain->MainChainLength();
+            minHeight = std::min(minHeight, height);
+            maxHeight = std::max(maxHeight, height);
+            chains.push_back(chain);
+        }
+        if (chains.empty())
+        {
+            minHeight = 0;
+            return 0;
+        }
+
+        // Fingerprints cover the whole prefix, so agreement at a height
+        // implies agreement below it and the agreed height can be bisected.
+        // Genesis (height 1) is common to all chains.
+        uint32_t agreed = 1;
+        uint32_t disagreed = minHeight + 1;
+        while (disagreed - agreed > 1)
+        {
+            uint32_t height = agreed + (disagreed - agreed) / 2;
+            uint64_t fingerprint = chains[0]->getMainChainFingerprint(height);
+            bool agree = true;
+            for (size_t c = 1; c < chains.size() && agree; ++c)
+            {
+                agree = chains[c]->getMainChainFingerprint(height) == fingerprint;
+            }
+            (agree ? agreed : disagreed) = height;
+        }
+        return agreed;
+    }
+
+void P2PManager::SampleAgreement()
+    {
+        uint32_t minHeight;
+        uint32_t maxHeight;
+        uint32_t agreed = FindAgreedHeight(minHeight, maxHeight);
+        agreementSeries << Simulator::Now().GetSeconds() << ',' << agreed << ',' << minHeight << ','
+                        << maxHeight << '\n';
+        uint32_t lag = maxHeight > agreed ? maxHeight - agreed : 0;
+        agreementSamples++;
+        agreementLagSum += lag;
+        agreementLagMax = std::max(agreementLagMax, lag);
+
+        if (Simulator::Now() + agreementInterval <= Seconds(simulationDuration))
+        {
+            Simulator::Schedule(agreementInterval, &P2PManager::SampleAgreement, this);
+        }
+        else
+        {
+            agreementSeries.flush();
+        }
+    }
+
+void P2PManager::PrintAgreement() const
+    {
+        if (agreementSamples == 0)
+        {
+            return;
+        }
+        uint32_t minHeight;
+        uint32_t maxHeight;
+        uint32_t agreed = FindAgreedHeight(minHeight, maxHeight);
+        std::cout << "=== Main-chain agreement ===" << std::endl;
+        std::cout << "Final: all nodes agree up to height " << agreed << " (main chains " << minHeight
+                  << "-" << maxHeight << ")" << std::endl;
+        std::cout << "Lag of the longest main chain behind agreement over " << agreementSamples
+                  << " samples: mean " << static_cast<double>(agreementLagSum) / agreementSamples
+                  << ", max " << agreementLagMax << std::endl;
+    }
+
+void P2PManager::ConnectNodes(uint32_t i, uint32_t j, double latencyMs)
+    {
+        PointToPointHelper p2pHelper;
+        p2pHelper.SetDeviceAttribute("DataRate", StringValue(linkDataRate));
+        p2pHelper.SetChannelAttribute("Delay", TimeValue(MilliSeconds(latencyMs)));
+
+        NodeContainer linkNodes;
+        linkNodes.Add(nodes.Get(i));
+        linkNodes.Add(nodes.Get(j));
+
+        NetDeviceContainer linkDevices = p2pHelper.Install(linkNodes);
+        if (!nodeUplink.empty())
+        {
+            // Each device transmits at the uplink of the node it belongs to
+            linkDevices.Get(0)->SetAttribute(
+                "DataRate", DataRateValue(DataRate(static_cast<uint64_t>(nodeUplink[i]))));
+            linkDevices.Get(1)->SetAttribute(
+                "DataRate", DataRateValue(DataRate(static_cast<uint64_t>(nodeUplink[j]))));
+        }
+
+        Ipv4InterfaceContainer ifc = addressHelper.Assign(linkDevices);
+        addressHelper.NewNetwork();
+
+        ConnectionInfo connInfo;
+        connInfo.devices = linkDevices;
+        connInfo.channel = linkDevices.Get(0)->GetChannel()->GetObject<PointToPointChannel>();
+        connInfo.ifc = ifc;
+
+        connections[std::make_pair(i, j)] = connInfo;
+        // any interface of a node reaches it once routing is populated
+        nodeAddresses[i] = ifc.GetAddress(0);
+        nodeAddresses[j] = ifc.GetAddress(1);
+    }
+
+    
+void P2PManager::ConnectPeerSockets(uint32_t i, uint32_t j)
+    {
+        const auto& conn = connections.at({i, j});
+        Ipv4Address addrJ = conn.ifc.GetAddress(1);
+
+        Ptr<Socket> socket = Socket::CreateSocket(nodes.Get(i), TcpSocketFactory::GetTypeId());
+
+        socket->Connect(InetSocketAddress(addrJ, j + 1000));
+
+        NS_LOG_INFO("connection " << i << ' ' << j << ' ' << addrJ);
+        p2pNodes[i]->AddPeerSocket(j, socket);
+    }
+
+    
+void P2PManager::EnablePeerRewiring(Time interval, uint32_t maxDegree)
+    {
+        if (!interval.IsStrictlyPositive())
+        {
+            return;
+        }
+        NS_ABORT_MSG_IF(lateJoiners > 0, "Peer rewiring cannot be combined with late joiners");
+        NS_ABORT_MSG_IF(maxDegree == 0, "Peer rewiring needs a degree bound of at least 1");
+        rewireInterval = interval;
+        rewireMaxDegree = maxDegree;
+        for (uint32_t i = 0; i < numNodes; ++i)
+        {
+            if (p2pNodes[i])
+            {
+                p2pNodes[i]->EnablePeerRewiring(interval, maxDegree, nodeAddresses);
+            }
+        }
+        if (propagationTracker)
+        {
+            propagationTracker->SetEpochs(Seconds(simulationDuration / 10.0), 10);
+        }
+    }
+
+void P2PManager::EnableLinkMonitoring(Time interval, const std::string& path)
+    {
+        if (!interval.IsStrictlyPositive())
+        {
+            return;
+        }
+        linkMonitor = std::make_unique<LinkMonitor>(interval, Seconds(simulationDuration));
+        for (const auto& connection : connections)
+        {
+            uint32_t i = connection.first.first;
+            uint32_t j = connection.first.second;
+            // device 0 sends from i to j, device 1 from j to i
+            if (IsLocalNode(i))
+            {
+                linkMonitor->AddDirection(i, j, connection.second.devices.Get(0));
+            }
+            if (IsLocalNode(j))
+            {
+                linkMonitor->AddDirection(j, i, connection.second.devices.Get(1));
+            }
+        }
+        linkMonitor->Start();
+        linkReportPath = systemCount > 1 ? path + ".rank" + std::to_string(systemId) : path;
+    }
+
+void P2PManager::EnableTimeSeries(Time interval, const std::string& path)
+    {
+        if (!interval.IsStrictlyPositive())
+        {
+            return;
+        }
+        std::string file = systemCount > 1 ? path + ".rank" + std::to_string(systemId) : path;
+        std::filesystem::path parent = std::filesystem::path(file).parent_path();
+        if (!parent.empty())
+        {
+            std::filesystem::create_directories(parent);
+        }
+        timeSeries.open(file);
+        if (!timeSeries.is_open())
+        {
+            NS_LOG_ERROR("Failed to open time series file " << file);
+            return;
+        }
+
+        timeSeries << "time,metric";
+        for (uint32_t i = 0; i < numNodes; ++i)
+        {
+            if (p2pNodes[i])
+            {
+                timeSeries << ",node" << i;
+            }
+        }
+        timeSeries << std::endl;
+
+        sampleInterval = interval;
+        Simulator::Schedule(sampleInterval, &P2PManager::SampleChains, this);
+    }
+
+void P2PManager::SampleChains()
+    {
+        double now = Simulator::Now().GetSeconds();
+        const char* metrics[] = {"tips", "pending", "height", "orphans"};
+        for (int metric = 0; metric < 4; ++metric)
+        {
+            timeSeries << now << ',' << metrics[metric];
+            for (const auto& node : p2pNodes)
+            {
+                if (!node)
+                {
+                    continue;
+                }
+                ShareChain* chain = node->GetShareChain();
+                switch (metric)
+                {
+                case 0:
+                    timeSeries << ',' << chain->getTipCount();
+                    break;
+                case 1:
+                    timeSeries << ',' << chain->getPendingCount();
+                    break;
+                case 2:
+                    timeSeries << ',' << chain->MainChainLength();
+                    break;
+                default:
+                    timeSeries << ',' << chain->getOrphanCount();
+                    break;
+                }
+            }
+            timeSeries << '\n';
+        }
+
+        if (Simulator::Now() + sampleInterval <= Seconds(simulationDuration))
+        {
+            Simulator::Schedule(sampleInterval, &P2PManager::SampleChains, this);
+        }
+        else
+        {
+            timeSeries.flush();
+        }
+    }
+
+void P2PManager::EnableEventLog(const std::string& path)
+    {
+        std::string file = systemCount > 1 ? path + ".rank" + std::to_string(systemId) : path;
+        std::filesystem::path parent = std::filesystem::path(file).parent_path();
+        if (!parent.empty())
+        {
+            std::filesystem::create_directories(parent);
+        }
+        eventLog = std::make_unique<EventLogWriter>(file, numNodes, ToShareTime(maxTime));
+        NS_ABORT_MSG_UNLESS(eventLog->isOpen(), "Cannot write event log " << file);
+        for (auto& node : p2pNodes)
+        {
+            if (node)
+            {
+                node->SetEventLog(eventLog.get());
+            }
+        }
+    }
+
+void P2PManager::LoadSnapshot(const std::string& path)
+    {
+        ShareTime latest;
+        NS_ABORT_MSG_UNLESS(ShareChain::readSnapshotLatestTimestamp(path, latest),
+                            "Cannot read snapshot " << path);
+        Time shift = NanoSeconds(-latest.GetNanoSeconds());
+        for (auto& node : p2pNodes)
+        {
+            if (node)
+            {
+                NS_ABORT_MSG_UNLESS(node->LoadSnapshot(path, shift), "Cannot load snapshot " << path);
+            }
+        }
+        NS_LOG_INFO("Preloaded snapshot " << path << " into every local node");
+    }
+
+void P2PManager::SaveSnapshotOnExit(const std::string& path)
+    {
+        snapshotOut = path;
+    }
+
+void P2PManager::ExportDagOnExit(const std::string& path, uint32_t minHeight, uint32_t maxHeight)
+    {
+        dagExportPath = path;
+        dagExportWindow.minHeight = minHeight;
+        if (maxHeight > 0)
+        {
+            dagExportWindow.maxHeight = maxHeight;
+        }
+    }
+
+void P2PManager::Run()
+    {
+        NS_LOG_FUNCTION(this);
+
+        NS_LOG_INFO("Starting simulation for " << simulationDuration << " seconds");
+        Simulator::Stop(Seconds(simulationDuration));
+        {
+            P2POOL_PROFILE_SCOPE("Simulator::Run");
+            Simulator::Run();
+        }
+        if (eventLog)
+        {
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                if (!p2pNodes[i])
+                {
+                    continue;
+                }
+                ShareChain* chain = p2pNodes[i]->GetShareChain();
+                ChainSummary summary;
+                summary.bestTip = chain->getBestTip();
+                summary.totalShares = chain->getTotalShares();
+                summary.mainChainLength = chain->MainChainLength();
+                summary.uncleBlocks = chain->getUncleBlocks();
+                summary.pendingShares = chain->getPendingCount();
+                eventLog->logSummary(ToShareTime(Simulator::Now()), i, summary);
+            }
+            NS_LOG_INFO("Event log holds " << eventLog->getRecordCount() << " records");
+            eventLog->close();
+        }
+        if (!snapshotOut.empty() && systemId == 0 && p2pNodes[0])
+        {
+            if (p2pNodes[0]->GetShareChain()->saveSnapshot(snapshotOut))
+            {
+                NS_LOG_INFO("Wrote snapshot " << snapshotOut);
+            }
+            else
+            {
+                NS_LOG_ERROR("Cannot write snapshot " << snapshotOut);
+            }
+        }
+        if (linkMonitor)
+        {
+            std::filesystem::path parent = std::filesystem::path(linkReportPath).parent_path();
+            if (!parent.empty())
+            {
+                std::filesystem::create_directories(parent);
+            }
+            if (!linkMonitor->WriteCsv(linkReportPath))
+            {
+                NS_LOG_ERROR("Cannot write link report " << linkReportPath);
+            }
+        }
+        if (!dagExportPath.empty() && systemId == 0 && p2pNodes[0])
+        {
+            std::ofstream out(dagExportPath);
+            bool dot = dagExportPath.size() >= 4 &&
+                       dagExportPath.compare(dagExportPath.size() - 4, 4, ".dot") == 0;
+            ShareChain::ExportFormat format =
+                dot ? ShareChain::ExportFormat::Dot : ShareChain::ExportFormat::Table;
+            if (!out.is_open() || !p2pNodes[0]->GetShareChain()->exportDag(out, format, dagExportWindow))
+            {
+                NS_LOG_ERROR("Cannot write DAG export " << dagExportPath);
+            }
+        }
+        Simulator::Destroy();
+        NS_LOG_INFO("Simulation completed");
+    }
+
+    
 void P2PManager::PrintResults()
     {
         NS_LOG_FUNCTION(this);
 
-        std::cout << "=== P2Pool Simulation Results ===" << std::endl;
+        if (systemCount == 1)
+        {
+            std::cout << "=== P2Pool Simulation Results ===" << std::endl;
+            uint32_t totalOrphans = 0;
+
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                p2pNodes[i]->PrintChainStats();
+                totalOrphans += p2pNodes[i]->getOrphanCount();
+            }
+
+            std::cout << "Average orphans per node: " << (double)totalOrphans / numNodes << std::endl;
+
+            propagationTracker->Finalize();
+            propagationTracker->PrintReport(std::cout);
+            std::vector<NodeStats> stats = GatherNodeStats();
+            PrintValidationReport(stats);
+            PrintSyncReport(stats);
+            PrintRegionReport(stats);
+            PrintRewiringReport(stats);
+            PrintTemplateReport(stats);
+            std::vector<double> payoutShares = GatherPayoutShares();
+            PrintStrategyReport(stats, payoutShares);
+            if (linkMonitor)
+            {
+                linkMonitor->PrintReport(std::cout, numNodes);
+            }
+            PrintDisruptions();
+            PrintAgreement();
+            PrintPayouts(payoutShares);
+            Profiler::PrintReport(std::cout);
+            return;
+        }
+
+        std::vector<NodeStats> stats = GatherNodeStats();
+        std::vector<double> payoutShares = GatherPayoutShares();
+        if (systemId != 0)
+        {
+            return;
+        }
+
+        std::cout << "=== P2Pool Simulation Results (" << systemCount << " ranks) ===" << std::endl;
         uint32_t totalOrphans = 0;
+        for (const NodeStats& node : stats)
+        {
+            std::cout << "Node " << node.nodeId << " statistics (rank "
+                      << nodeSystemId[node.nodeId] << "):" << std::endl;
+            std::cout << "  - Shares created: " << node.sharesCreated << std::endl;
+            std::cout << "  - Shares received: " << node.sharesReceived << std::endl;
+            std::cout << "  - Shares sent: " << node.sharesSent << std::endl;
+            std::cout << "  - Orphan count: " << node.orphanCount << std::endl;
+            std::cout << "  - Total Shares: " << node.totalShares << std::endl;
+            std::cout << "  - Uncle BLocks " << node.uncleBlocks << std::endl;
+            std::cout << "  - MAin chainlen: " << node.mainChainLength << std::endl;
+            std::cout << "  - Best tip: " << (static_cast<ShareId>(node.bestTipHigh) << 32 | node.bestTipLow)
+                      << std::endl;
+            std::cout << "  - Next share difficulty: " << node.nextDifficultyMilli / 1000.0 << std::endl;
+            std::cout << "  - Main chain share interval: " << node.windowIntervalMs / 1000.0 << "s"
+                      << std::endl;
+            totalOrphans += node.orphanCount;
+        }
+
+        std::cout << "Average orphans per node: " << (double)totalOrphans / numNodes << std::endl;
+        PrintValidationReport(stats);
+        PrintSyncReport(stats);
+        PrintRegionReport(stats);
+        PrintRewiringReport(stats);
+        PrintTemplateReport(stats);
+        PrintStrategyReport(stats, payoutShares);
+        PrintPayouts(payoutShares);
+        Profiler::PrintReport(std::cout);
+    }
 
+std::vector<double> P2PManager::GatherPayoutShares()
+    {
+        std::vector<double> shares(numNodes, 0.0);
+        if (payoutWindow == 0)
+        {
+            return shares;
+        }
         for (uint32_t i = 0; i < numNodes; ++i)
         {
-            p2pNodes[i]->PrintChainStats();
-            totalOrphans += p2pNodes[i]->getOrphanCount();
+            if (!p2pNodes[i])
+            {
+                continue;
+            }
+            ShareChain* chain = p2pNodes[i]->GetShareChain();
+            if (chain->getPayoutTotal() <= 0)
+            {
+                continue;
+            }
+            for (const auto& credit : chain->getPayoutCredits())
+            {
+                if (credit.first < numNodes)
+                {
+                    shares[credit.first] += credit.second / chain->getPayoutTotal() / numNodes;
+                }
+            }
         }
 
-        std::cout << "Average orphans per node: " << (double)totalOrphans / numNodes << std::endl;
+#ifdef NS3_MPI
+        if (systemCount > 1)
+        {
+            std::vector<double> total(numNodes, 0.0);
+            MPI_Reduce(shares.data(), total.data(), numNodes, MPI_DOUBLE, MPI_SUM, 0,
+                       MpiInterface::GetCommunicator());
+            return total;
+        }
+#endif
+        return shares;
+    }
+
+void P2PManager::PrintValidationReport(const std::vector<NodeStats>& stats) const
+    {
+        if (validationFixedCost.IsZero() && validationPerRefCost.IsZero())
+        {
+            return;
+        }
+        std::cout << "=== Validation queue (" << validationFixedCost.GetMicroSeconds() << "us + "
+                  << validationPerRefCost.GetMicroSeconds() << "us/ref, " << validationWorkers
+                  << " workers, " << (validationPriority ? "best-tip priority" : "FIFO")
+                  << ") ===" << std::endl;
+        std::cout << "node  meanDelayMs  p99DelayMs  maxQueue  orphans" << std::endl;
+        double totalMean = 0;
+        for (const NodeStats& node : stats)
+        {
+            std::cout << node.nodeId << "  " << node.queueDelayMeanUs / 1000.0 << "  "
+                      << node.queueDelayP99Us / 1000.0 << "  " << node.maxQueueLength << "  "
+                      << node.orphanCount << std::endl;
+            totalMean += node.queueDelayMeanUs / 1000.0;
+        }
+        std::cout << "Mean queueing delay per node: " << totalMean / stats.size() << "ms" << std::endl;
+    }
+
+void P2PManager::PrintSyncReport(const std::vector<NodeStats>& stats) const
+    {
+        if (lateJoiners == 0)
+        {
+            return;
+        }
+        std::cout << "=== Late joiner sync (join at " << joinTime.GetSeconds() << "s, "
+                  << syncBatchSize << " shares per batch) ===" << std::endl;
+        for (const NodeStats& node : stats)
+        {
+            if (node.nodeId < numNodes - lateJoiners)
+            {
+                continue;
+            }
+            std::cout << "Node " << node.nodeId << ": " << node.syncedShares << " shares";
+            if (node.syncMs > 0)
+            {
+                std::cout << " in " << node.syncMs / 1000.0 << "s ("
+                          << node.syncedShares * 1000.0 / node.syncMs << " shares/s)";
+            }
+            else
+            {
+                std::cout << ", sync incomplete";
+            }
+            if (node.catchUpMs > 0)
+            {
+                std::cout << ", tip caught up after " << node.catchUpMs / 1000.0 << "s";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+void P2PManager::PrintRegionReport(const std::vector<NodeStats>& stats) const
+    {
+        if (regionNames.empty())
+        {
+            return;
+        }
+        size_t regions = regionNames.size();
+        std::vector<uint32_t> regionNodes(regions, 0);
+        std::vector<double> regionPower(regions, 0.0);
+        std::vector<double> regionUplink(regions, 0.0);
+        std::vector<double> regionOrphans(regions, 0.0);
+        double totalPower = 0;
+        for (const NodeStats& node : stats)
+        {
+            uint32_t r = nodeRegion[node.nodeId];
+            regionNodes[r]++;
+            regionPower[r] += hashPower[node.nodeId];
+            regionUplink[r] += nodeUplink.empty() ? DataRate(linkDataRate).GetBitRate()
+                                                  : nodeUplink[node.nodeId];
+            regionOrphans[r] += node.orphanCount;
+            totalPower += hashPower[node.nodeId];
+        }
+
+        // Stale shares need one chain holding every region's shares, which
+        // only exists when the whole network is in one process
+        std::vector<uint32_t> regionMined(regions, 0);
+        std::vector<uint32_t> regionStale(regions, 0);
+        if (systemCount == 1)
+        {
+            std::vector<uint32_t> mined;
+            std::vector<uint32_t> stale;
+            CountStaleShares(p2pNodes[0]->GetShareChain(), mined, stale);
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                regionMined[nodeRegion[i]] += mined[i];
+                regionStale[nodeRegion[i]] += stale[i];
+            }
+        }
+
+        std::cout << "=== Regions (link jitter up to " << regionJitterMs << "ms) ===" << std::endl;
+        std::cout << "region  nodes  hashpower%  uplinkMbps  orphansPerNode  staleShares%"
+                  << std::endl;
+        for (size_t r = 0; r < regions; ++r)
+        {
+            if (regionNodes[r] == 0)
+            {
+                continue;
+            }
+            std::cout << regionNames[r] << "  " << regionNodes[r] << "  "
+                      << 100 * regionPower[r] / totalPower << "  "
+                      << regionUplink[r] / regionNodes[r] / 1e6 << "  "
+                      << regionOrphans[r] / regionNodes[r] << "  ";
+            if (regionMined[r] > 0)
+            {
+                std::cout << 100.0 * regionStale[r] / regionMined[r];
+            }
+            else
+            {
+                std::cout << "-";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+void P2PManager::PrintRewiringReport(const std::vector<NodeStats>& stats) const
+    {
+        if (!rewireInterval.IsStrictlyPositive())
+        {
+            return;
+        }
+        uint64_t dropped = 0;
+        uint64_t dialled = 0;
+        uint64_t degreeSum = 0;
+        uint32_t minDegree = std::numeric_limits<uint32_t>::max();
+        uint32_t maxDegree = 0;
+        for (const NodeStats& node : stats)
+        {
+            dropped += node.peersDropped;
+            dialled += node.peersDialled;
+            degreeSum += node.peerCount;
+            minDegree = std::min(minDegree, node.peerCount);
+            maxDegree = std::max(maxDegree, node.peerCount);
+        }
+        std::cout << "=== Peer rewiring (every " << rewireInterval.GetSeconds() << "s, at most "
+                  << rewireMaxDegree << " peers) ===" << std::endl;
+        std::cout << "Peers dropped: " << dropped << ", dialled: " << dialled << std::endl;
+        std::cout << "Final degree: mean " << (double)degreeSum / stats.size() << ", min "
+                  << minDegree << ", max " << maxDegree << std::endl;
+        if (systemCount > 1)
+        {
+            return;
+        }
+
+        // stale shares by creation time, on the first node's chain
+        const uint32_t epochs = 10;
+        double epochLength = simulationDuration / static_cast<double>(epochs);
+        std::vector<uint32_t> mined(epochs, 0);
+        std::vector<uint32_t> stale(epochs, 0);
+        const ShareChain* chain = p2pNodes[0]->GetShareChain();
+        for (const Share* share : chain->getSharesAfter(chain->getGenesisShare()->getShareId()))
+        {
+            double at = std::max(share->getTimestamp().GetSeconds(), 0.0);
+            uint32_t epoch = std::min<uint32_t>(at / epochLength, epochs - 1);
+            mined[epoch]++;
+            if (!chain->isOnMainChain(share->getShareId()))
+            {
+                stale[epoch]++;
+            }
+        }
+        std::cout << "from  shares  staleShares%" << std::endl;
+        for (uint32_t e = 0; e < epochs; ++e)
+        {
+            std::cout << e * epochLength << "s  " << mined[e] << "  "
+                      << (mined[e] ? 100.0 * stale[e] / mined[e] : 0) << std::endl;
+        }
+    }
+
+void P2PManager::PrintTemplateReport(const std::vector<NodeStats>& stats) const
+    {
+        if (!templatePushDelay.IsStrictlyPositive() && !templateRefreshInterval.IsStrictlyPositive())
+        {
+            return;
+        }
+        uint64_t created = 0;
+        uint64_t staleWork = 0;
+        uint64_t staleWorkOrphans = 0;
+        uint64_t ageSumMs = 0;
+        for (const NodeStats& node : stats)
+        {
+            created += node.sharesCreated;
+            staleWork += node.staleWorkShares;
+            staleWorkOrphans += node.staleWorkOrphans;
+            ageSumMs += static_cast<uint64_t>(node.templateAgeMeanMs) * node.sharesCreated;
+        }
+        std::cout << "=== Work templates (push delay " << templatePushDelay.GetMilliSeconds()
+                  << "ms, refresh every " << templateRefreshInterval.GetSeconds() << "s) ==="
+                  << std::endl;
+        std::cout << "Shares found: " << created << ", on stale work: " << staleWork << " ("
+                  << (created ? 100.0 * staleWork / created : 0) << "%)" << std::endl;
+        std::cout << "Mean template age when a share was found: "
+                  << (created ? (double)ageSumMs / created : 0) << "ms" << std::endl;
+        std::cout << "Stale-work shares off the finder's main chain: " << staleWorkOrphans << " ("
+                  << (staleWork ? 100.0 * staleWorkOrphans / staleWork : 0) << "%)" << std::endl;
+        if (systemCount > 1)
+        {
+            return;
+        }
+
+        // the other shares, judged on their finder's chain the same way
+        uint64_t fresh = 0;
+        uint64_t freshOrphans = 0;
+        for (uint32_t i = 0; i < numNodes; ++i)
+        {
+            const ShareChain* chain = p2pNodes[i]->GetShareChain();
+            uint32_t orphans = 0;
+            for (const Share* share : chain->getSharesAfter(chain->getGenesisShare()->getShareId()))
+            {
+                if (share->getSenderId() == i && !chain->isOnMainChain(share->getShareId()))
+                {
+                    orphans++;
+                }
+            }
+            fresh += p2pNodes[i]->GetSharesCreated() - p2pNodes[i]->GetStaleWorkShares();
+            freshOrphans += orphans - p2pNodes[i]->GetStaleWorkOrphans();
+        }
+        std::cout << "Fresh-work shares off the finder's main chain: " << freshOrphans << " ("
+                  << (fresh ? 100.0 * freshOrphans / fresh : 0) << "%)" << std::endl;
+    }
+
+void P2PManager::CountStaleShares(const ShareChain* chain,
+                                  std::vector<uint32_t>& mined,
+                                  std::vector<uint32_t>& stale) const
+    {
+        mined.assign(numNodes, 0);
+        stale.assign(numNodes, 0);
+        for (const Share* share : chain->getSharesAfter(chain->getGenesisShare()->getShareId()))
+        {
+            if (share->getSenderId() >= numNodes)
+            {
+                continue;
+            }
+            mined[share->getSenderId()]++;
+            if (!chain->isOnMainChain(share->getShareId()))
+            {
+                stale[share->getSenderId()]++;
+            }
+        }
+    }
+
+void P2PManager::PrintStrategyReport(const std::vector<NodeStats>& stats,
+                                     const std::vector<double>& payoutShares) const
+    {
+        const char* names[] = {"honest", "selfish", "delay"};
+        const size_t kinds = 3;
+        if (std::all_of(minerStrategies.begin(), minerStrategies.end(),
+                        [](P2PoolNode::MinerStrategy s) { return s == P2PoolNode::HONEST_MINER; }))
+        {
+            return;
+        }
+
+        // The first honest node's chain is the public view the stale
+        // shares are judged by; it needs every node in this process
+        std::vector<uint32_t> mined;
+        std::vector<uint32_t> stale;
+        if (systemCount == 1)
+        {
+            for (uint32_t i = 0; i < numNodes; ++i)
+            {
+                if (minerStrategies[i] == P2PoolNode::HONEST_MINER)
+                {
+                    CountStaleShares(p2pNodes[i]->GetShareChain(), mined, stale);
+                    break;
+                }
+            }
+        }
+
+        std::vector<uint32_t> kindNodes(kinds, 0);
+        std::vector<double> kindPower(kinds, 0.0);
+        std::vector<double> kindPayout(kinds, 0.0);
+        std::vector<uint32_t> kindMined(kinds, 0);
+        std::vector<uint32_t> kindStale(kinds, 0);
+        std::vector<double> kindOrphanRate(kinds, 0.0);
+        double totalPower = 0;
+        for (const NodeStats& node : stats)
+        {
+            size_t k = minerStrategies[node.nodeId];
+            kindNodes[k]++;
+            kindPower[k] += hashPower[node.nodeId];
+            kindPayout[k] += payoutShares[node.nodeId];
+            if (!mined.empty())
+            {
+                kindMined[k] += mined[node.nodeId];
+                kindStale[k] += stale[node.nodeId];
+            }
+            // orphans in the node's own view of the chain
+            kindOrphanRate[k] += node.totalShares ? (double)node.orphanCount / node.totalShares : 0;
+            totalPower += hashPower[node.nodeId];
+        }
+
+        std::cout << "=== Miner strategies (delay miners hold shares " << releaseDelay.GetSeconds()
+                  << "s) ===" << std::endl;
+        std::cout << "strategy  nodes  hashpower%  staleShares%  orphanRate%  payout%  payout/hashpower"
+                  << std::endl;
+        for (size_t k = 0; k < kinds; ++k)
+        {
+            if (kindNodes[k] == 0)
+            {
+                continue;
+            }
+            double powerShare = kindPower[k] / totalPower;
+            std::cout << names[k] << "  " << kindNodes[k] << "  " << 100 * powerShare << "  ";
+            if (kindMined[k] > 0)
+            {
+                std::cout << 100.0 * kindStale[k] / kindMined[k];
+            }
+            else
+            {
+                std::cout << "-";
+            }
+            std::cout << "  " << 100 * kindOrphanRate[k] / kindNodes[k] << "  ";
+            if (payoutWindow > 0)
+            {
+                std::cout << 100 * kindPayout[k] << "  " << kindPayout[k] / powerShare;
+            }
+            else
+            {
+                std::cout << "-  -";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+void P2PManager::PrintPayouts(const std::vector<double>& payoutShares) const
+    {
+        if (payoutWindow == 0)
+        {
+            return;
+        }
+        double totalPower = 0;
+        for (double power : hashPower)
+        {
+            totalPower += power;
+        }
+        std::cout << "=== PPLNS payouts (last " << payoutWindow << " main-chain shares, uncle weight "
+                  << uncleWeight << ") ===" << std::endl;
+        std::cout << "node  hashpower%  payout%  payout/hashpower" << std::endl;
+        for (uint32_t i = 0; i < numNodes; ++i)
+        {
+            double powerShare = hashPower[i] / totalPower;
+            std::cout << i << "  " << 100 * powerShare << "  " << 100 * payoutShares[i] << "  "
+                      << payoutShares[i] / powerShare << std::endl;
+        }
+    }
+
+std::vector<P2PManager::NodeStats> P2PManager::GatherNodeStats()
+    {
+        std::vector<NodeStats> local;
+        for (uint32_t i = 0; i < numNodes; ++i)
+        {
+            if (!p2pNodes[i])
+            {
+                continue;
+            }
+            ShareChain* chain = p2pNodes[i]->GetShareChain();
+            NodeStats node;
+            node.nodeId = i;
+            node.sharesCreated = p2pNodes[i]->GetSharesCreated();
+            node.sharesReceived = p2pNodes[i]->GetSharesReceived();
+            node.sharesSent = p2pNodes[i]->GetSharesSent();
+            node.orphanCount = chain->getOrphanCount();
+            node.totalShares = chain->getTotalShares();
+            node.uncleBlocks = chain->getUncleBlocks();
+            node.mainChainLength = chain->MainChainLength();
+            node.bestTipHigh = chain->getBestTip() >> 32;
+            node.bestTipLow = static_cast<uint32_t>(chain->getBestTip());
+            node.nextDifficultyMilli = std::lround(chain->getNextShareDifficulty() * 1000);
+            node.windowIntervalMs = std::lround(chain->getWindowInterval() * 1000);
+            P2PoolNode* app = PeekPointer(p2pNodes[i]);
+            Time requested = app->GetSyncRequestTime();
+            node.syncedShares = app->GetSyncedShares();
+            node.syncMs = app->GetSyncCompleteTime().IsZero()
+                              ? 0
+                              : (app->GetSyncCompleteTime() - requested).GetMilliSeconds();
+            node.catchUpMs = app->GetCatchUpTime().IsZero()
+                                 ? 0
+                                 : (app->GetCatchUpTime() - requested).GetMilliSeconds();
+            node.queueDelayMeanUs = std::lround(app->GetQueueDelays().mean() * 1e6);
+            node.queueDelayP99Us = std::lround(app->GetQueueDelays().quantile(0.99) * 1e6);
+            node.maxQueueLength = app->GetMaxQueueLength();
+            node.peersDropped = app->GetPeersDropped();
+            node.peersDialled = app->GetPeersDialled();
+            node.peerCount = app->GetPeerCount();
+            node.staleWorkShares = app->GetStaleWorkShares();
+            node.staleWorkOrphans = app->GetStaleWorkOrphans();
+            node.templateAgeMeanMs = node.sharesCreated
+                                         ? app->GetTemplateAgeSum().GetMilliSeconds() / node.sharesCreated
+                                         : 0;
+            local.push_back(node);
+        }
+
+#ifdef NS3_MPI
+        if (systemCount > 1)
+        {
+            // NodeStats is a plain block of uint32_t fields, so it travels as
+            // an array of MPI_UNSIGNED.
+            const int fields = sizeof(NodeStats) / sizeof(uint32_t);
+            MPI_Comm comm = MpiInterface::GetCommunicator();
+            int localCount = local.size() * fields;
+            std::vector<int> counts(systemCount, 0);
+            MPI_Gather(&localCount, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, comm);
+
+            std::vector<int> displs(systemCount, 0);
+            for (uint32_t r = 1; r < systemCount; ++r)
+            {
+                displs[r] = displs[r - 1] + counts[r - 1];
+            }
+            std::vector<NodeStats> all;
+            if (systemId == 0)
+            {
+                all.resize((displs[systemCount - 1] + counts[systemCount - 1]) / fields);
+            }
+            MPI_Gatherv(local.data(), localCount, MPI_UNSIGNED,
+                        all.data(), counts.data(), displs.data(), MPI_UNSIGNED, 0, comm);
+            std::sort(all.begin(), all.end(), [](const NodeStats& a, const NodeStats& b) {
+                return a.nodeId < b.nodeId;
+            });
+            return all;
+        }
+#endif
+        return local;
     }
 
    
-Ptr<NormalRandomVariable> P2PManager::CreateShareGenTimeModel(uint32_t nodeId)
+Ptr<RandomVariableStream> P2PManager::CreateShareGenTimeModel(uint32_t nodeId)
     {
-        double hashPowerFactor = 0.5 + ((nodeId * 7919) % 100) / 100.0;
+        double hashPowerFactor = hashPower[nodeId];
+
+        if (arrivalModel == SUPERPOSED_ARRIVALS)
+        {
+            return nullptr;
+        }
+
+        if (arrivalModel == EXPONENTIAL_ARRIVALS)
+        {
+            double meanPower = 0;
+            for (double power : hashPower)
+            {
+                meanPower += power / numNodes;
+            }
+            double mean = shareGenMean * meanPower / hashPowerFactor;
+            Ptr<ExponentialRandomVariable> shareGenModel = CreateObject<ExponentialRandomVariable>();
+            shareGenModel->SetAttribute("Mean", DoubleValue(mean));
+            NS_LOG_INFO("Created exponential share generation model for node "
+                        << nodeId << " with mean=" << mean << " (hash power " << hashPowerFactor
+                        << ")");
+            return shareGenModel;
+        }
+
         double mean = shareGenMean / hashPowerFactor;
         double variance = shareGenVariance / hashPowerFactor;
 
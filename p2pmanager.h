@@ -1,3 +1,4 @@
+#include "linkmonitor.h"
 #include "node.h"
 
 #include "ns3/applications-module.h"
@@ -10,10 +11,17 @@
 #include "ns3/point-to-point-module.h"
 #include "ns3/random-variable-stream.h"
 
+#ifdef NS3_MPI
+#include "ns3/mpi-interface.h"
+#endif
+
+#include <fstream>
 #include <iostream>
 #include <utility>
 #include <map>
 #include <memory>
+#include <random>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -39,12 +47,252 @@ class P2PManager
                uint32_t simulationDuration,
                Time maxTimeStamp);
 
+    /**
+     * Selects how nodes find shares. Call before CreateRandomTopology.
+     *
+     * @param arrivalModel "normal": per-node normal intervals clamped to 0.1 s
+     *        (legacy); "exponential": a Poisson process per node;
+     *        "superposed": one Poisson process for all local miners, each
+     *        share credited to a miner in proportion to its hash power.
+     * @param hashPowerDistribution "legacy" (fixed 0.5-1.5 spread),
+     *        "uniform" (U(0.5, 1.5)), "pareto" or "file:<path>" with one
+     *        value per line in node order.
+     * @param paretoShape Shape of the Pareto distribution (scale 1).
+     */
+    void ConfigureMining(const std::string& arrivalModel,
+                         const std::string& hashPowerDistribution,
+                         double paretoShape = 1.5);
+
+    /**
+     * Enables share difficulty retargeting on every node, P2Pool style: each
+     * new share's difficulty is set so that the pool hash rate measured over
+     * the last window main-chain shares yields one share per targetInterval.
+     * Share intervals drawn by the arrival model are scaled by the
+     * difficulty. Call before CreateRandomTopology.
+     *
+     * @param window Main-chain shares to average over (0 keeps difficulty 1).
+     * @param targetInterval Wanted main-chain share interval in seconds.
+     */
+    void SetDifficultyRetarget(uint32_t window, double targetInterval);
+
+    /**
+     * Enables the PPLNS payout window on every node's share chain.
+     * PrintResults then compares each miner's payout share with its hash
+     * power share. Call before CreateRandomTopology.
+     *
+     * @param window Main-chain shares paid (0 disables the payout report).
+     * @param uncleWeight Fraction of its difficulty an uncle share earns.
+     */
+    void SetPayoutWindow(uint32_t window, double uncleWeight);
+
+    /**
+     * Sets how long the propagation tracker follows a share before it is
+     * reported as incomplete; later arrivals of it are not counted. Keep it
+     * above the longest outage of a churn or partition scenario.
+     * Call before CreateRandomTopology.
+     */
+    void SetPropagationExpiry(Time expiry);
+
+    /**
+     * Gives every node a simulated validation CPU cost for received shares
+     * (see P2PoolNode::SetValidationCost). PrintResults then reports each
+     * node's queueing delay next to its orphan count.
+     * Call before CreateRandomTopology.
+     */
+    void SetValidationCost(Time fixedCost, Time perRefCost, uint32_t workers, bool priority);
+
+    /**
+     * Sets the data rate of every point-to-point link (ns-3 DataRate
+     * string, e.g. "5Mbps"). Call before CreateRandomTopology.
+     */
+    void SetLinkDataRate(const std::string& rate);
+
+    /**
+     * Places every node in a geographic region. A link's one-way delay is
+     * half the RTT between its endpoints' regions plus a per-link jitter
+     * drawn uniformly from [0, jitterMs], instead of the common topology
+     * latency. PrintResults breaks propagation latency and stale shares
+     * down by region. Call before CreateRandomTopology.
+     *
+     * @param model "none" (common latency), "world" (five continents with
+     *        typical RTTs and node shares) or "file:<path>" with one line
+     *        per region: name, node weight, then the RTT in ms to every
+     *        region in file order.
+     * @param jitterMs Largest extra one-way delay of a link.
+     */
+    void SetRegions(const std::string& model, double jitterMs);
+
+    /**
+     * Gives every node an access uplink; each link direction then sends at
+     * the uplink rate of its sender instead of the common link data rate.
+     * Call before CreateRandomTopology.
+     *
+     * @param distribution "fixed" (common link data rate), "lognormal" or
+     *        "file:<path>" with one rate in Mbps per line in node order.
+     * @param medianMbps Median uplink of the lognormal distribution.
+     * @param sigma Standard deviation of the logarithm of the uplink.
+     */
+    void SetAccessBandwidth(const std::string& distribution, double medianMbps, double sigma);
+
+    /**
+     * Counts bytes, packets and drops on both directions of every link and
+     * samples utilization and device queue occupancy every interval.
+     * PrintResults reports per-link and per-node percentiles, and a CSV
+     * with one row per direction is written when the run ends. Under MPI
+     * each rank monitors the directions its nodes send on.
+     * Call after CreateRandomTopology.
+     *
+     * @param interval Sampling period (0 disables; longer = less overhead).
+     * @param path CSV output file (an MPI rank appends ".rank<N>").
+     */
+    void EnableLinkMonitoring(Time interval, const std::string& path);
+
+    /**
+     * Makes some nodes strategic miners (see P2PoolNode::SetMinerStrategy);
+     * all others stay honest. PrintResults compares the stale shares,
+     * orphan rates and payouts of honest and strategic miners.
+     * Call before CreateRandomTopology.
+     *
+     * @param spec Comma-separated "<node>:<strategy>" entries, with strategy
+     *        honest, selfish or delay (e.g. "0:selfish,7:delay").
+     * @param releaseDelay How long a delay miner holds each share.
+     */
+    void SetMinerStrategies(const std::string& spec, Time releaseDelay);
+
+    /**
+     * Makes every node build its shares from a work template that lags the
+     * chain (see P2PoolNode::SetWorkTemplate). PrintResults reports the
+     * shares found on stale work and how many of them missed the main
+     * chain. Call before CreateRandomTopology.
+     *
+     * @param pushDelay Time from a best-tip change to the new work (0 = at once).
+     * @param refreshInterval Period of template rebuilds (0 disables).
+     */
+    void SetWorkTemplate(Time pushDelay, Time refreshInterval);
+
+    /**
+     * Lets every node rewire its peers by observed delivery latency (see
+     * P2PoolNode::EnablePeerRewiring); new peers are dialled over the
+     * routed network and need not share a link. PrintResults reports the
+     * rewiring counts and degrees, and propagation latency and stale
+     * shares per tenth of the run. Partitions then also cut dialled
+     * connections across the cut. Cannot be combined with late joiners.
+     * Call after CreateRandomTopology.
+     *
+     * @param interval Scoring round length (0 keeps the topology's peers).
+     * @param maxDegree Most peers a node dials up to or keeps.
+     */
+    void EnablePeerRewiring(Time interval, uint32_t maxDegree);
+
+    /**
+     * Lets the last count nodes join the network late. Their links stay
+     * down and they find no shares until joinTime; then they connect,
+     * catch up with a headers-first sync and start mining. PrintResults
+     * reports sync throughput and the time until each joiner's chain holds
+     * the tip its sync peer advertised. Call before CreateRandomTopology.
+     *
+     * @param count Number of late-joining nodes (0 = everyone starts at once).
+     * @param joinTime Time the late nodes join; after the 5 s connection setup.
+     * @param batchSize Shares per sync message.
+     */
+    void SetLateJoiners(uint32_t count, Time joinTime, uint32_t batchSize = 500);
+
     /**
      * Sets up the simulation environment including node creation,
      * network setup, and initial configuration.
+     *
+     * When ns-3 runs with the distributed simulator the nodes are spread
+     * over all MPI ranks; every rank builds the same topology (the topology
+     * RNG is seeded from the ns-3 seed/run) but only installs applications
+     * on the nodes it owns.
      */
     void CreateRandomTopology(double connectionProbability = 0.3, double latency = 5.0);
 
+    /**
+     * Samples the tip count, pending shares, main-chain height and orphan
+     * estimate of every local node at a fixed interval and streams them to
+     * a CSV file with one row per metric and one column per node.
+     * Call after CreateRandomTopology and before Run.
+     *
+     * @param interval Sampling period.
+     * @param path Output file (an MPI rank appends ".rank<N>").
+     */
+    void EnableTimeSeries(Time interval, const std::string& path);
+
+    /**
+     * Schedules churn and partition events from a scenario file with one
+     * event per line ('#' starts a comment):
+     *
+     *   <seconds> leave <node>          node goes offline, keeping its chain
+     *   <seconds> join <node>           node comes back and resyncs
+     *   <seconds> linkdown <a> <b>      the link between a and b drops traffic
+     *   <seconds> linkup <a> <b>        the link carries traffic again
+     *   <seconds> partition <n,n,...>   cut every link between the set and the rest
+     *   <seconds> heal                  restore all links cut by partitions
+     *
+     * Links are gated in the applications; the TCP connections stay up.
+     * Restored links and rejoining nodes resync. Call after CreateRandomTopology.
+     */
+    void LoadChurnScenario(const std::string& path);
+
+    /**
+     * Takes random nodes offline at leaveRate per second (Poisson) for an
+     * exponentially distributed time with mean meanDowntime seconds.
+     * The choices are seeded like the topology, so all ranks agree.
+     * Call after CreateRandomTopology.
+     */
+    void EnableRandomChurn(double leaveRate, double meanDowntime);
+
+    /**
+     * After every churn or partition event, checks every interval whether
+     * the best tips of all online nodes agree and reports how long that
+     * took. Only available when the whole network runs in one process.
+     */
+    void EnableConvergenceTracking(Time interval);
+
+    /**
+     * Every interval, finds the deepest main-chain height at which all
+     * online nodes hold the same shares, and the spread of their main-chain
+     * heights, and writes them as one CSV row. Agreement is found by binary
+     * search over the chains' rolling fingerprints, so a sample costs
+     * O(nodes log height). Only available when the whole network runs in
+     * one process. Call after CreateRandomTopology.
+     */
+    void EnableAgreementSampling(Time interval, const std::string& path);
+
+    /**
+     * Records every share handed to a local node's chain, and each node's
+     * final chain, to a binary event log for tools/replay.
+     * Call after CreateRandomTopology.
+     *
+     * @param path Output file (an MPI rank appends ".rank<N>").
+     */
+    void EnableEventLog(const std::string& path);
+
+    /**
+     * Preloads every local node's chain with a ShareChain snapshot at t=0,
+     * so long-horizon runs start from a common warmed-up DAG. Timestamps
+     * are moved so the newest snapshot share lies at time 0.
+     * Call after CreateRandomTopology.
+     */
+    void LoadSnapshot(const std::string& path);
+
+    /**
+     * Writes the first node's chain to a snapshot when the run ends, for
+     * use with LoadSnapshot. Only rank 0 writes under MPI.
+     */
+    void SaveSnapshotOnExit(const std::string& path);
+
+    /**
+     * Streams the first node's DAG to a file when the run ends: Graphviz
+     * DOT if the path ends in ".dot", a tab-separated share table
+     * otherwise. Only rank 0 writes under MPI.
+     *
+     * @param minHeight Lowest exported height (0 = from genesis).
+     * @param maxHeight Highest exported height (0 = up to the tips).
+     */
+    void ExportDagOnExit(const std::string& path, uint32_t minHeight = 0, uint32_t maxHeight = 0);
+
     /**
      * Runs the simulation for the specified duration.
      */
@@ -56,7 +304,58 @@ class P2PManager
     void PrintResults();
 
   private:
-    
+    /**
+     * A link of the random topology, decided before any ns-3 node exists so
+     * that nodes can be created on the rank the partitioner assigns them to.
+     */
+    struct LinkSpec
+    {
+        uint32_t a;
+        uint32_t b;
+        double latencyMs;
+    };
+
+    /**
+     * Per-node statistics gathered from every rank at the end of the run.
+     */
+    struct NodeStats
+    {
+        uint32_t nodeId;
+        uint32_t sharesCreated;
+        uint32_t sharesReceived;
+        uint32_t sharesSent;
+        uint32_t orphanCount;
+        uint32_t totalShares;
+        uint32_t uncleBlocks;
+        uint32_t mainChainLength;
+        // 64-bit share ID split in halves to keep the struct all uint32_t
+        uint32_t bestTipHigh;
+        uint32_t bestTipLow;
+        // fixed point, thousandths
+        uint32_t nextDifficultyMilli;
+        uint32_t windowIntervalMs;
+        uint32_t syncedShares;
+        // measured from the sync request, 0 if it did not happen
+        uint32_t syncMs;
+        uint32_t catchUpMs;
+        uint32_t queueDelayMeanUs;
+        uint32_t queueDelayP99Us;
+        uint32_t maxQueueLength;
+        uint32_t peersDropped;
+        uint32_t peersDialled;
+        uint32_t peerCount;
+        uint32_t staleWorkShares;
+        uint32_t staleWorkOrphans;
+        uint32_t templateAgeMeanMs;
+    };
+
+    enum ArrivalModel
+    {
+        NORMAL_ARRIVALS,
+        EXPONENTIAL_ARRIVALS,
+        SUPERPOSED_ARRIVALS
+    };
+
     uint32_t numNodes;
     double shareGenMean;
     double shareGenVariance;
@@ -68,6 +367,67 @@ class P2PManager
     Ipv4AddressHelper addressHelper;
     InternetStackHelper internet;
     Time maxTime;
+    Time propagationExpiry;
+
+    // Difficulty retargeting (window 0 = disabled)
+    uint32_t retargetWindow;
+    double targetInterval;
+
+    // PPLNS payout window (window 0 = disabled)
+    uint32_t payoutWindow;
+    double uncleWeight;
+
+    // Validation cost model of received shares
+    Time validationFixedCost;
+    Time validationPerRefCost;
+    uint32_t validationWorkers;
+    bool validationPriority;
+
+    // The last lateJoiners nodes join at joinTime
+    uint32_t lateJoiners;
+    Time joinTime;
+    uint32_t syncBatchSize;
+    bool lateNodesJoined;
+
+    /**
+     * A churn or partition event and when the best tips agreed again.
+     */
+    struct Disruption
+    {
+        Time at;
+        std::string description;
+        Time convergedAt;
+        bool converged;
+    };
+
+    // Churn state, replicated on every rank
+    std::vector<bool> nodeOnline;
+    std::set<std::pair<uint32_t, uint32_t>> downLinks;
+    std::set<std::pair<uint32_t, uint32_t>> partitionedLinks;
+    std::mt19937 churnRng;
+    double churnRate;
+    double churnDowntime;
+
+    // Share arrival log for offline replay (may be null)
+    std::unique_ptr<EventLogWriter> eventLog;
+
+    // Snapshot and DAG export written at the end of Run (empty = none)
+    std::string snapshotOut;
+    std::string dagExportPath;
+    ShareChain::ExportWindow dagExportWindow;
+
+    // Convergence measurement (interval 0 = disabled)
+    std::vector<Disruption> disruptions;
+    Time convergenceInterval;
+    bool convergenceCheckPending;
+
+    // Main-chain agreement sampling (interval 0 = disabled); the lag is how
+    // far the longest main chain runs ahead of the agreed height
+    Time agreementInterval;
+    std::ofstream agreementSeries;
+    uint32_t agreementSamples;
+    uint64_t agreementLagSum;
+    uint32_t agreementLagMax;
     struct ConnectionInfo
     {
         NetDeviceContainer devices;
@@ -76,6 +436,64 @@ class P2PManager
     };
 
     std::map<std::pair<uint32_t, uint32_t>, ConnectionInfo> connections;
+
+    std::vector<LinkSpec> links;
+    std::string linkDataRate;
+
+    // Geographic regions (none = common latency), RTTs in ms
+    std::vector<std::string> regionNames;
+    std::vector<double> regionWeights;
+    std::vector<std::vector<double>> regionRtt;
+    double regionJitterMs;
+    std::vector<uint32_t> nodeRegion;
+
+    // Access uplink of every node in bit/s (empty = linkDataRate)
+    std::string uplinkDistribution;
+    double uplinkMedianMbps;
+    double uplinkSigma;
+    std::vector<double> nodeUplink;
+
+    // Link counters (may be null) and their CSV report
+    std::unique_ptr<LinkMonitor> linkMonitor;
+    std::string linkReportPath;
+
+    // Peer rewiring round length (0 = fixed peers) and degree bound
+    Time rewireInterval;
+    uint32_t rewireMaxDegree;
+
+    // Publication strategy of every node
+    std::vector<P2PoolNode::MinerStrategy> minerStrategies;
+    Time releaseDelay;
+
+    // Work template push delay and refresh period of every node
+    Time templatePushDelay;
+    Time templateRefreshInterval;
+
+    // Share arrival process and relative hash power of every node
+    ArrivalModel arrivalModel;
+    std::string hashPowerDistribution;
+    double paretoShape;
+    std::vector<double> hashPower;
+
+    // Superposed arrivals: local miners, their share rates at difficulty 1,
+    // and the cumulative rates at their current difficulties (scratch)
+    std::vector<uint32_t> localMiners;
+    std::vector<double> minerRate;
+    std::vector<double> cumulativeMinerRate;
+    Ptr<ExponentialRandomVariable> networkShareInterval;
+    Ptr<UniformRandomVariable> minerSelector;
+
+    // Periodic chain sampling
+    Time sampleInterval;
+    std::ofstream timeSeries;
+
+    // Share propagation statistics (sequential runs only)
+    std::unique_ptr<PropagationTracker> propagationTracker;
+
+    // MPI rank of every node (all zero in a sequential run)
+    std::vector<uint32_t> nodeSystemId;
+    uint32_t systemId;
+    uint32_t systemCount;
      
     /**
       * Each peer starts generating shares
@@ -98,10 +516,205 @@ class P2PManager
     void ConnectPeerSockets(uint32_t i, uint32_t j);
 
     /**
-     * Creates a normal distribution model for share generation interval.
+     * Returns true if node i is simulated by this rank.
+     */
+    bool IsLocalNode(uint32_t i) const;
+
+    /**
+     * Returns true if node i joins late and has not joined yet.
+     */
+    bool IsWaitingToJoin(uint32_t i) const;
+
+    /**
+     * Takes a node offline or brings it back.
+     */
+    void SetNodeOnline(uint32_t node, bool online, const std::string& reason);
+
+    /**
+     * Sets a link down or up by hand (linkdown/linkup events).
+     */
+    void SetLinkDown(uint32_t a, uint32_t b, bool down);
+
+    /**
+     * Cuts every link between the given nodes and the rest of the network.
+     */
+    void Partition(const std::vector<uint32_t>& side);
+
+    /**
+     * Restores all links cut by partitions.
+     */
+    void Heal();
+
+    /**
+     * Blocks or unblocks a link on its local endpoints, according to the
+     * manual and partition state.
+     */
+    void ApplyLinkState(uint32_t a, uint32_t b);
+
+    /**
+     * Random churn: schedules the next departure, and takes a node offline.
+     */
+    void ScheduleNextChurn();
+    void ChurnNode();
+
+    /**
+     * Records a disruption and starts polling for best-tip agreement.
+     */
+    void RecordDisruption(const std::string& description);
+
+    /**
+     * Marks the open disruptions converged if all online best tips agree.
+     */
+    void CheckConvergence();
+
+    /**
+     * Prints every disruption with the time its best tips took to agree.
+     */
+    void PrintDisruptions() const;
+
+    /**
+     * Gets the time between two propagation expiry checks.
+     */
+    Time PropagationCheckInterval() const;
+
+    /**
+     * Expires the shares in flight too long and schedules the next check.
+     * It runs in the global context, so that under MTP all nodes have
+     * recorded their arrivals up to now when it does.
+     */
+    void ExpirePropagation();
+
+    /**
+     * Gets the deepest height at which the main chains of all online nodes
+     * agree, and their shortest and longest main chains.
+     */
+    uint32_t FindAgreedHeight(uint32_t& minHeight, uint32_t& maxHeight) const;
+
+    /**
+     * Writes one agreement sample and schedules the next.
+     */
+    void SampleAgreement();
+
+    /**
+     * Prints the mean and worst agreement lag over all samples.
+     */
+    void PrintAgreement() const;
+
+    /**
+     * Connects the late nodes' links, starts their sync and their mining.
+     */
+    void JoinLateNodes();
+
+    /**
+     * Prints the validation queueing delay and orphan count of every node.
+     */
+    void PrintValidationReport(const std::vector<NodeStats>& stats) const;
+
+    /**
+     * Prints sync throughput and catch-up time of the late joiners.
+     */
+    void PrintSyncReport(const std::vector<NodeStats>& stats) const;
+
+    /**
+     * Assigns every node to one of numRanks ranks with balanced sizes.
+     * Low-latency links are kept inside a rank wherever possible, so the
+     * links that do cross ranks are few and slow; the slowest cut link is
+     * what bounds the lookahead of the distributed simulator.
+     */
+    std::vector<uint32_t> PartitionNodes(uint32_t numRanks) const;
+
+    /**
+     * Writes one time-series sample of every local node and schedules the next.
+     */
+    void SampleChains();
+
+    /**
+     * Collects the statistics of every node on rank 0.
+     * Other ranks receive an empty vector.
+     */
+    std::vector<NodeStats> GatherNodeStats();
+
+    /**
+     * Fraction of the payout window credited to each miner, averaged over
+     * the chain views of all nodes. Valid on rank 0 only.
+     */
+    std::vector<double> GatherPayoutShares();
+
+    /**
+     * Prints nodes, uplink and mean orphan count per region and, in a
+     * sequential run, the fraction of each region's shares that missed the
+     * first node's main chain.
+     */
+    void PrintRegionReport(const std::vector<NodeStats>& stats) const;
+
+    /**
+     * Prints hash power, stale shares, orphan rate and payout per miner
+     * strategy, if any node is not honest. Stale shares are counted on the
+     * chain of the first honest node in a sequential run only.
+     */
+    void PrintStrategyReport(const std::vector<NodeStats>& stats,
+                             const std::vector<double>& payoutShares) const;
+
+    /**
+     * Prints peer rewiring counts, final degrees and, in a sequential run,
+     * the stale shares of the first node's chain per tenth of the run.
+     */
+    void PrintRewiringReport(const std::vector<NodeStats>& stats) const;
+
+    /**
+     * Prints the shares found on stale work, the share of them off the
+     * finder's main chain against that of the other shares, and the mean
+     * template age, if the work template model is on.
+     */
+    void PrintTemplateReport(const std::vector<NodeStats>& stats) const;
+
+    /**
+     * Counts, per miner, the shares in a chain and those off its main chain.
+     */
+    void CountStaleShares(const ShareChain* chain,
+                          std::vector<uint32_t>& mined,
+                          std::vector<uint32_t>& stale) const;
+
+    /**
+     * Prints the payout share of every miner next to its hash power share.
+     */
+    void PrintPayouts(const std::vector<double>& payoutShares) const;
+
+    /**
+     * Draws the hash power of every node from the configured distribution.
+     * Uses a generator seeded like the topology, so all ranks agree.
+     */
+    void AssignHashPower();
+
+    /**
+     * Draws every node's region by the region weights and every link's
+     * delay from the RTT matrix and the jitter. Seeded like the topology.
+     */
+    void AssignRegions();
+
+    /**
+     * Draws every node's uplink from the configured distribution.
+     * Seeded like the topology.
+     */
+    void AssignUplinks();
+
+    /**
+     * Creates the share interval model of a node for the arrival model.
      *
      * @param nodeId ID of the node.
-     * @return A pointer to a NormalRandomVariable for share timing.
+     * @return Interval model in seconds, or null for superposed arrivals.
+     */
+    Ptr<RandomVariableStream> CreateShareGenTimeModel(uint32_t nodeId);
+
+    /**
+     * Schedules the next share of the superposed arrival process and picks
+     * its miner, each miner's rate scaled by its own work difficulty.
+     */
+    void ScheduleNextNetworkShare();
+
+    /**
+     * Lets the picked miner generate the share at the difficulty its rate
+     * was drawn for.
      */
-    Ptr<NormalRandomVariable> CreateShareGenTimeModel(uint32_t nodeId);
+    void GenerateNetworkShare(uint32_t miner, double difficulty);
 };
@@ -0,0 +1,120 @@
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct SiteCounters {
+    uint64_t calls = 0;
+    uint64_t nanos = 0;
+};
+
+// Per-thread counters, indexed by site. Tables are owned by the registry and
+// outlive their threads so that a report can still read them.
+struct ThreadTable {
+    std::vector<SiteCounters> sites;
+};
+
+struct Registry {
+    std::mutex lock;
+    std::vector<std::string> names;
+    std::vector<std::unique_ptr<ThreadTable>> tables;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+ThreadTable& threadTable() {
+    thread_local ThreadTable* table = nullptr;
+    if (!table) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> guard(reg.lock);
+        reg.tables.push_back(std::make_unique<ThreadTable>());
+        table = reg.tables.back().get();
+    }
+    return *table;
+}
+
+struct MergedSite {
+    std::string name;
+    SiteCounters counters;
+};
+
+std::vector<MergedSite> merge() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    std::vector<MergedSite> merged(reg.names.size());
+    for (size_t i = 0; i < reg.names.size(); ++i) {
+        merged[i].name = reg.names[i];
+    }
+    for (const auto& table : reg.tables) {
+        for (size_t i = 0; i < table->sites.size() && i < merged.size(); ++i) {
+            merged[i].counters.calls += table->sites[i].calls;
+            merged[i].counters.nanos += table->sites[i].nanos;
+        }
+    }
+    std::sort(merged.begin(), merged.end(), [](const MergedSite& a, const MergedSite& b) {
+        return a.counters.nanos > b.counters.nanos;
+    });
+    return merged;
+}
+
+}
+
+uint32_t Profiler::RegisterSite(const char* name) {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> guard(reg.lock);
+    auto it = std::find(reg.names.begin(), reg.names.end(), name);
+    if (it != reg.names.end()) return it - reg.names.begin();
+    reg.names.push_back(name);
+    return reg.names.size() - 1;
+}
+
+void Profiler::Record(uint32_t site, uint64_t nanos) {
+    ThreadTable& table = threadTable();
+    if (site >= table.sites.size()) table.sites.resize(site + 1);
+    table.sites[site].calls++;
+    table.sites[site].nanos += nanos;
+}
+
+void Profiler::PrintReport(std::ostream& os) {
+    std::vector<MergedSite> sites = merge();
+    os << "=== Hot-path Profile (inclusive wall clock) ===" << std::endl;
+#ifdef P2POOL_NO_PROFILE
+    os << "  profiling compiled out (P2POOL_NO_PROFILE)" << std::endl;
+#endif
+    os << "  " << std::left << std::setw(36) << "site" << std::right
+       << std::setw(12) << "calls" << std::setw(14) << "total ms" << std::setw(14) << "mean ns"
+       << std::endl;
+    for (const MergedSite& site : sites) {
+        if (site.counters.calls == 0) continue;
+        os << "  " << std::left << std::setw(36) << site.name << std::right
+           << std::setw(12) << site.counters.calls
+           << std::setw(14) << std::fixed << std::setprecision(2) << site.counters.nanos / 1e6
+           << std::setw(14) << std::setprecision(0)
+           << (double)site.counters.nanos / site.counters.calls << std::endl;
+    }
+    os << std::defaultfloat << std::setprecision(6);
+}
+
+bool Profiler::WriteJson(const std::string& path) {
+    std::ofstream out(path);
+    if (!out.is_open()) return false;
+    std::vector<MergedSite> sites = merge();
+    out << "{\"sites\":[";
+    bool first = true;
+    for (const MergedSite& site : sites) {
+        if (site.counters.calls == 0) continue;
+        out << (first ? "" : ",") << "{\"name\":\"" << site.name << "\",\"calls\":"
+            << site.counters.calls << ",\"nanos\":" << site.counters.nanos << "}";
+        first = false;
+    }
+    out << "]}" << std::endl;
+    return true;
+}
@@ -0,0 +1,74 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * Low-overhead wall-clock profiler for the simulation hot paths.
+ *
+ * Each instrumented scope is a "site" with a call counter and an accumulated
+ * duration. Counters live in thread-local tables and are merged only when a
+ * report is produced, so recording never takes a lock. Times are inclusive:
+ * a site nested in another (or in itself) is counted in both.
+ *
+ * Build with -DP2POOL_NO_PROFILE to compile every P2POOL_PROFILE_SCOPE out.
+ */
+class Profiler {
+public:
+    /**
+     * Registers a named site and returns its index (called once per site).
+     */
+    static uint32_t RegisterSite(const char* name);
+
+    /**
+     * Adds one call of the given duration to a site of the calling thread.
+     */
+    static void Record(uint32_t site, uint64_t nanos);
+
+    /**
+     * Prints calls, total and mean time of every site, merged over threads.
+     */
+    static void PrintReport(std::ostream& os);
+
+    /**
+     * Writes the merged counters as JSON.
+     * @return false if the file could not be written
+     */
+    static bool WriteJson(const std::string& path);
+};
+
+/**
+ * Times the enclosing scope and records it on destruction.
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(uint32_t site)
+        : site(site), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        Profiler::Record(site, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+private:
+    uint32_t site;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define P2POOL_PROFILE_CONCAT_INNER(a, b) a##b
+#define P2POOL_PROFILE_CONCAT(a, b) P2POOL_PROFILE_CONCAT_INNER(a, b)
+
+#ifndef P2POOL_NO_PROFILE
+#define P2POOL_PROFILE_SCOPE(name)                                                           \
+    static const uint32_t P2POOL_PROFILE_CONCAT(p2poolProfileSite, __LINE__) =              \
+        Profiler::RegisterSite(name);                                                        \
+    ScopedTimer P2POOL_PROFILE_CONCAT(p2poolProfileTimer, __LINE__)(                         \
+        P2POOL_PROFILE_CONCAT(p2poolProfileSite, __LINE__))
+#else
+#define P2POOL_PROFILE_SCOPE(name) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,265 @@
+#include "propagationtracker.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <mutex>
+
+namespace {
+// Samples at or below this value share the first bucket (1 microsecond)
+const double kMinValue = 1e-6;
+// Largest value with its own bucket (about three hours)
+const double kMaxValue = 1e4;
+}
+
+LatencySketch::LatencySketch(double relativeAccuracy)
+    : gamma((1 + relativeAccuracy) / (1 - relativeAccuracy)),
+      logGamma(std::log(gamma)),
+      samples(0), sum(0), maxValue(0) {
+    buckets.assign(bucketIndex(kMaxValue) + 1, 0);
+}
+
+size_t LatencySketch::bucketIndex(double value) const {
+    if (value <= kMinValue) return 0;
+    value = std::min(value, kMaxValue);
+    return 1 + static_cast<size_t>(std::ceil(std::log(value / kMinValue) / logGamma));
+}
+
+void LatencySketch::add(double value) {
+    buckets[bucketIndex(value)]++;
+    samples++;
+    sum += static_cast<uint64_t>(std::llround(value / kMinValue));
+    maxValue = std::max(maxValue, value);
+}
+
+double LatencySketch::quantile(double q) const {
+    if (samples == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * (samples - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen > rank) {
+            if (i == 0) return kMinValue;
+            // midpoint (in log space) of the bucket (gamma^(i-2), gamma^(i-1)]
+            double value = kMinValue * 2 * std::pow(gamma, i - 1) / (gamma + 1);
+            return std::min(value, maxValue);
+        }
+    }
+    return maxValue;
+}
+
+uint64_t LatencySketch::count() const {
+    return samples;
+}
+
+double LatencySketch::mean() const {
+    return samples ? sum * kMinValue / samples : 0;
+}
+
+double LatencySketch::max() const {
+    return maxValue;
+}
+
+PropagationTracker::PropagationTracker(uint32_t numNodes, ns3::Time expiry)
+    : numNodes(numNodes), expiry(expiry),
+      reach50((numNodes + 1) / 2), reach90((numNodes * 9 + 9) / 10),
+      sharesTracked(0), sharesComplete(0), sharesIncomplete(0), peakInFlight(0) {}
+
+void PropagationTracker::SetRegions(const std::vector<uint32_t>& nodeRegion,
+                                    const std::vector<std::string>& regionNames) {
+    this->nodeRegion = nodeRegion;
+    this->regionNames = regionNames;
+    size_t regions = regionNames.size();
+    regionCoverage90.assign(regions, LatencySketch());
+    regionFirstSeen.assign(regions * regions, LatencySketch());
+}
+
+void PropagationTracker::SetEpochs(ns3::Time length, uint32_t count) {
+    epochLength = length;
+    epochCoverage50.assign(count, LatencySketch());
+    epochCoverage90.assign(count, LatencySketch());
+}
+
+void PropagationTracker::RecordGenerated(ShareId shareId, uint32_t nodeId, ns3::Time now) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (inFlight.count(shareId)) return;
+
+    InFlightShare& share = inFlight[shareId];
+    share.origin = now;
+    share.originNode = nodeId;
+    share.reached = 1;
+    share.firstSeen.assign(numNodes, -1.0f);
+    share.hops.assign(numNodes, 0);
+    share.firstSeen[nodeId] = 0.0f;
+    sharesTracked++;
+
+    if (share.reached == numNodes) {
+        foldShare(share, true);
+        inFlight.erase(shareId);
+        return;
+    }
+    // nodes on different threads record out of simulation-time order
+    std::pair<ns3::Time, ShareId> entry(now, shareId);
+    creationOrder.insert(std::upper_bound(creationOrder.begin(), creationOrder.end(), entry),
+                         entry);
+}
+
+void PropagationTracker::RecordReceived(ShareId shareId, uint32_t nodeId, uint32_t fromNodeId,
+                                        ns3::Time now) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = inFlight.find(shareId);
+    if (it == inFlight.end()) return;
+    InFlightShare& share = it->second;
+    if (share.firstSeen[nodeId] >= 0) return;
+
+    float sinceOrigin = static_cast<float>((now - share.origin).GetSeconds());
+    share.firstSeen[nodeId] = sinceOrigin;
+    share.reached++;
+    firstSeenLatency.add(sinceOrigin);
+    if (!nodeRegion.empty()) {
+        size_t origin = nodeRegion[share.originNode];
+        regionFirstSeen[origin * regionNames.size() + nodeRegion[nodeId]].add(sinceOrigin);
+    }
+
+    if (fromNodeId < numNodes && share.firstSeen[fromNodeId] >= 0) {
+        hopDelay.add(sinceOrigin - share.firstSeen[fromNodeId]);
+        share.hops[nodeId] = share.hops[fromNodeId] + 1;
+    }
+
+    if (share.reached == numNodes) {
+        foldShare(share, true);
+        inFlight.erase(it);
+    }
+}
+
+void PropagationTracker::foldShare(InFlightShare& share, bool complete) {
+    // Coverage times are read off the sorted row instead of being taken
+    // when the n-th arrival is recorded: nodes running on different threads
+    // record arrivals out of simulation-time order.
+    sortedSeen.clear();
+    for (float seen : share.firstSeen) {
+        if (seen >= 0) sortedSeen.push_back(seen);
+    }
+    std::sort(sortedSeen.begin(), sortedSeen.end());
+    size_t epoch = 0;
+    if (!epochCoverage90.empty()) {
+        epoch = std::min<size_t>(share.origin.GetNanoSeconds() / epochLength.GetNanoSeconds(),
+                                 epochCoverage90.size() - 1);
+    }
+    if (reach50 > 1 && sortedSeen.size() >= reach50) {
+        coverage50.add(sortedSeen[reach50 - 1]);
+        if (!epochCoverage50.empty()) epochCoverage50[epoch].add(sortedSeen[reach50 - 1]);
+    }
+    if (reach90 > 1 && sortedSeen.size() >= reach90) {
+        coverage90.add(sortedSeen[reach90 - 1]);
+        if (!nodeRegion.empty()) {
+            regionCoverage90[nodeRegion[share.originNode]].add(sortedSeen[reach90 - 1]);
+        }
+        if (!epochCoverage90.empty()) epochCoverage90[epoch].add(sortedSeen[reach90 - 1]);
+    }
+    if (complete) {
+        sharesComplete++;
+        coverage100.add(sortedSeen.back());
+    } else {
+        sharesIncomplete++;
+    }
+    for (uint32_t i = 0; i < numNodes; ++i) {
+        if (share.firstSeen[i] < 0 || i == share.originNode) continue;
+        if (share.hops[i] >= hopCounts.size()) hopCounts.resize(share.hops[i] + 1, 0);
+        hopCounts[share.hops[i]]++;
+    }
+}
+
+void PropagationTracker::ExpireShares(ns3::Time now) {
+    std::lock_guard<std::mutex> guard(lock);
+    peakInFlight = std::max(peakInFlight, inFlight.size());
+    while (!creationOrder.empty() && creationOrder.front().first + expiry < now) {
+        auto it = inFlight.find(creationOrder.front().second);
+        if (it != inFlight.end()) {
+            foldShare(it->second, false);
+            inFlight.erase(it);
+        }
+        creationOrder.pop_front();
+    }
+}
+
+void PropagationTracker::Finalize() {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto& entry : inFlight) {
+        foldShare(entry.second, false);
+    }
+    inFlight.clear();
+    creationOrder.clear();
+}
+
+void PropagationTracker::PrintReport(std::ostream& os) const {
+    os << "=== Share Propagation ===" << std::endl;
+    os << "Shares tracked: " << sharesTracked << " (complete " << sharesComplete
+       << ", incomplete " << sharesIncomplete << " after " << expiry.GetSeconds() << "s in flight"
+       << ", peak in flight " << peakInFlight << ")" << std::endl;
+
+    auto row = [&os](const char* name, const LatencySketch& sketch) {
+        os << "  " << std::left << std::setw(18) << name << std::right << std::fixed
+           << std::setprecision(4)
+           << std::setw(10) << sketch.quantile(0.5)
+           << std::setw(10) << sketch.quantile(0.9)
+           << std::setw(10) << sketch.quantile(0.99)
+           << std::setw(10) << sketch.max()
+           << std::setw(10) << sketch.mean()
+           << std::setw(10) << sketch.count() << std::endl;
+    };
+    os << "  " << std::left << std::setw(18) << "latency (s)" << std::right
+       << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+       << std::setw(10) << "max" << std::setw(10) << "mean" << std::setw(10) << "n" << std::endl;
+    row("reach 50%", coverage50);
+    row("reach 90%", coverage90);
+    row("reach 100%", coverage100);
+    row("first seen", firstSeenLatency);
+    row("per hop", hopDelay);
+    os << std::defaultfloat;
+
+    uint64_t arrivals = 0;
+    uint64_t hopSum = 0;
+    for (size_t h = 0; h < hopCounts.size(); ++h) {
+        arrivals += hopCounts[h];
+        hopSum += h * hopCounts[h];
+    }
+    os << "Hops per arrival: mean " << (arrivals ? (double)hopSum / arrivals : 0)
+       << ", max " << (hopCounts.empty() ? 0 : hopCounts.size() - 1) << std::endl;
+
+    if (!epochCoverage90.empty()) {
+        os << "Coverage by share creation time (s):" << std::endl;
+        os << "  " << std::left << std::setw(18) << "from" << std::right << std::setw(10)
+           << "50% p50" << std::setw(10) << "90% p50" << std::setw(10) << "90% p90"
+           << std::setw(10) << "n" << std::endl;
+        os << std::fixed << std::setprecision(4);
+        for (size_t e = 0; e < epochCoverage90.size(); ++e) {
+            std::string from = std::to_string(static_cast<int64_t>(e * epochLength.GetSeconds())) + "s";
+            os << "  " << std::left << std::setw(18) << from << std::right
+               << std::setw(10) << epochCoverage50[e].quantile(0.5)
+               << std::setw(10) << epochCoverage90[e].quantile(0.5)
+               << std::setw(10) << epochCoverage90[e].quantile(0.9)
+               << std::setw(10) << epochCoverage90[e].count() << std::endl;
+        }
+        os << std::defaultfloat;
+    }
+
+    if (regionNames.empty()) return;
+    os << "Reach 90% by origin region (s):" << std::endl;
+    for (size_t r = 0; r < regionNames.size(); ++r) {
+        row(regionNames[r].c_str(), regionCoverage90[r]);
+    }
+    os << "Median first-seen latency (s), origin region by row:" << std::endl;
+    os << "  " << std::left << std::setw(18) << "" << std::right;
+    for (const std::string& name : regionNames) {
+        os << std::setw(10) << name;
+    }
+    os << std::endl << std::fixed << std::setprecision(4);
+    for (size_t from = 0; from < regionNames.size(); ++from) {
+        os << "  " << std::left << std::setw(18) << regionNames[from] << std::right;
+        for (size_t to = 0; to < regionNames.size(); ++to) {
+            os << std::setw(10) << regionFirstSeen[from * regionNames.size() + to].quantile(0.5);
+        }
+        os << std::endl;
+    }
+    os << std::defaultfloat;
+}
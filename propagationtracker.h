@@ -0,0 +1,172 @@
+#ifndef PROPAGATIONTRACKER_H
+#define PROPAGATIONTRACKER_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ns3/nstime.h"
+#include "share.h"
+
+/**
+ * Streaming quantile sketch with logarithmically spaced buckets.
+ * Every quantile is reported with a bounded relative error, and the memory
+ * footprint does not grow with the number of samples.
+ */
+class LatencySketch {
+public:
+    /**
+     * @param relativeAccuracy relative error bound of reported quantiles
+     */
+    explicit LatencySketch(double relativeAccuracy = 0.01);
+
+    /**
+     * Adds a sample (in seconds, or any non-negative unit).
+     */
+    void add(double value);
+
+    /**
+     * Returns the q-quantile (0 <= q <= 1), or 0 if the sketch is empty.
+     */
+    double quantile(double q) const;
+
+    uint64_t count() const;
+    double mean() const;
+    double max() const;
+
+private:
+    // Index of the bucket holding value; bucket 0 collects values <= minValue
+    size_t bucketIndex(double value) const;
+
+    double gamma;
+    double logGamma;
+    std::vector<uint64_t> buckets;
+    uint64_t samples;
+    // in units of the first bucket bound, so the sum does not depend on the
+    // order the samples were added in
+    uint64_t sum;
+    double maxValue;
+};
+
+/**
+ * Simulation-wide tracker of how fast shares spread through the network.
+ *
+ * While a share is in flight its first-seen time and hop count at every node
+ * are kept in a dense row; once the share has reached every node (or has been
+ * in flight longer than the expiry) the row is folded into quantile sketches
+ * and freed. Memory therefore scales with nodes x shares-in-flight, not with
+ * the total number of shares.
+ *
+ * The recording calls are serialised by a mutex, so nodes simulated on
+ * different threads can share one tracker. Expiry only happens in
+ * ExpireShares, which the owner calls from a global event, so the report
+ * does not depend on the order threads record in.
+ */
+class PropagationTracker {
+public:
+    /**
+     * @param numNodes number of nodes a share has to reach
+     * @param expiry time after which an incomplete share stops being tracked
+     */
+    PropagationTracker(uint32_t numNodes, ns3::Time expiry);
+
+    /**
+     * Breaks the statistics down by region: 90% coverage latency per origin
+     * region and first-seen latency per origin and destination region.
+     * @param nodeRegion region index of every node
+     * @param regionNames name of every region
+     */
+    void SetRegions(const std::vector<uint32_t>& nodeRegion,
+                    const std::vector<std::string>& regionNames);
+
+    /**
+     * Breaks the coverage latency down by the time shares were created,
+     * in count epochs of the given length (the last one is open-ended),
+     * to show how propagation changes over a run.
+     */
+    void SetEpochs(ns3::Time length, uint32_t count);
+
+    /**
+     * Records that nodeId created shareId at time now.
+     */
+    void RecordGenerated(ShareId shareId, uint32_t nodeId, ns3::Time now);
+
+    /**
+     * Records that nodeId received shareId from fromNodeId at time now.
+     * Only the first arrival at a node is counted.
+     */
+    void RecordReceived(ShareId shareId, uint32_t nodeId, uint32_t fromNodeId, ns3::Time now);
+
+    /**
+     * Folds the shares that have been in flight longer than the expiry at
+     * time now, and samples the number of shares in flight for the peak.
+     */
+    void ExpireShares(ns3::Time now);
+
+    /**
+     * Folds every share still in flight into the statistics.
+     */
+    void Finalize();
+
+    /**
+     * Prints coverage latency percentiles, per-hop delays and hop counts,
+     * and the per-region and per-epoch breakdowns if they are set.
+     */
+    void PrintReport(std::ostream& os) const;
+
+private:
+    struct InFlightShare {
+        ns3::Time origin;
+        uint32_t originNode;
+        uint32_t reached;
+        // seconds since origin per node, negative while not yet seen
+        std::vector<float> firstSeen;
+        std::vector<uint16_t> hops;
+    };
+
+    void foldShare(InFlightShare& share, bool complete);
+
+    uint32_t numNodes;
+    ns3::Time expiry;
+    uint32_t reach50;
+    uint32_t reach90;
+
+    std::unordered_map<ShareId, InFlightShare> inFlight;
+    // (origin, share) sorted by origin, so expiry only looks at the front;
+    // entries of shares that completed are skipped when they come up
+    std::deque<std::pair<ns3::Time, ShareId>> creationOrder;
+    // first-seen times of the share being folded, reused between shares
+    std::vector<float> sortedSeen;
+    std::mutex lock;
+
+    LatencySketch coverage50;
+    LatencySketch coverage90;
+    LatencySketch coverage100;
+    LatencySketch firstSeenLatency;
+    LatencySketch hopDelay;
+    std::vector<uint64_t> hopCounts;
+
+    // Per-region breakdown (empty = no regions)
+    std::vector<uint32_t> nodeRegion;
+    std::vector<std::string> regionNames;
+    // indexed by origin region
+    std::vector<LatencySketch> regionCoverage90;
+    // indexed by origin region * regions + destination region
+    std::vector<LatencySketch> regionFirstSeen;
+
+    // Per-epoch breakdown by share origin time (empty = no epochs)
+    ns3::Time epochLength;
+    std::vector<LatencySketch> epochCoverage50;
+    std::vector<LatencySketch> epochCoverage90;
+
+    uint64_t sharesTracked;
+    uint64_t sharesComplete;
+    uint64_t sharesIncomplete;
+    // largest number of shares in flight seen by ExpireShares
+    size_t peakInFlight;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#!/usr/bin/env bash
+# Wall-clock scaling of the distributed simulation for 1, 2, 4 and 8 ranks.
+# Run from the ns-3 root of an MPI-enabled build (./ns3 configure --enable-mpi).
+#
+#   scratch/p2pool/scripts/mpi-scaling.sh [extra simulation arguments]
+#
+# e.g. scratch/p2pool/scripts/mpi-scaling.sh --numNodes=2000 --simDuration=100
+
+set -euo pipefail
+
+RANKS="${RANKS:-1 2 4 8}"
+
+printf "%-6s %-12s %-8s\n" "ranks" "wall_s" "speedup"
+base=""
+for k in $RANKS; do
+    start=$(date +%s.%N)
+    ./ns3 run scratch/p2pool/main.cc --no-build \
+        --command-template="mpiexec -np $k %s $*" > "mpi-scaling-$k.log" 2>&1
+    end=$(date +%s.%N)
+    wall=$(echo "$end - $start" | bc -l)
+    if [ -z "$base" ]; then
+        base=$wall
+    fi
+    printf "%-6s %-12.2f %-8.2f\n" "$k" "$wall" "$(echo "$base / $wall" | bc -l)"
+done
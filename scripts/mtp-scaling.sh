@@ -0,0 +1,47 @@
+#!/usr/bin/env bash
+# Wall-clock scaling of the multithreaded simulation for 1 to 64 threads.
+# Run from the ns-3 root of a build with the mtp module (./ns3 configure
+# --enable-mtp) and the program compiled with -DNS3_MTP.
+#
+#   scratch/p2pool/scripts/mtp-scaling.sh [extra simulation arguments]
+#
+# e.g. THREADS="1 16 32 64" scratch/p2pool/scripts/mtp-scaling.sh --numNodes=2000 --simDuration=100
+#
+# The final "Average orphans per node" line of every run is printed too,
+# and the report of every run is compared with the one of the first thread
+# count: apart from the wall-clock profile it has to be identical, otherwise
+# the script prints the difference and fails.
+
+set -euo pipefail
+
+THREADS="${THREADS:-1 2 4 8 16 32 64}"
+
+# the report without the wall-clock profile, which is printed last
+report() {
+    sed '/=== Hot-path Profile/,$d' "$1"
+}
+
+printf "%-8s %-12s %-8s %s\n" "threads" "wall_s" "speedup" "orphans/node"
+base=""
+first=""
+status=0
+for t in $THREADS; do
+    start=$(date +%s.%N)
+    ./ns3 run scratch/p2pool/main.cc --no-build -- --threads="$t" --verbose=false "$@" \
+        > "mtp-scaling-$t.log" 2>&1
+    end=$(date +%s.%N)
+    wall=$(echo "$end - $start" | bc -l)
+    if [ -z "$base" ]; then
+        base=$wall
+        first=$t
+    fi
+    orphans=$(grep "Average orphans per node" "mtp-scaling-$t.log" | tail -1 | awk '{print $NF}')
+    printf "%-8s %-12.2f %-8.2f %s\n" "$t" "$wall" "$(echo "$base / $wall" | bc -l)" "$orphans"
+    if ! diff <(report "mtp-scaling-$first.log") <(report "mtp-scaling-$t.log") \
+        > "mtp-scaling-$t.diff"; then
+        echo "report with $t threads differs from $first threads (mtp-scaling-$t.diff):"
+        head -20 "mtp-scaling-$t.diff"
+        status=1
+    fi
+done
+exit $status
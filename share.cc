@@ -2,31 +2,35 @@
 #include <vector>
 #include <ctime>
 #include <cstdint>
-#include "ns3/simulator.h"
 
-Share::Share(uint64_t shareId, uint32_t senderId, ns3::Time timestamp, 
-    const std::vector<uint32_t>& prevShares, uint32_t parId)
-: shareId(shareId), senderId(senderId), timestamp(timestamp), prevShares(prevShares) , parentId(parId) {}
+Share::Share(ShareId shareId, uint32_t senderId, ShareTime timestamp, 
+    const std::vector<ShareId>& prevShares, ShareId parId, double difficulty)
+: shareId(shareId), senderId(senderId), timestamp(timestamp), prevShares(prevShares) , parentId(parId),
+  difficulty(difficulty) {}
 
 uint32_t Share::getSenderId() const {
     return senderId;
 }
 
-uint32_t Share::getShareId() const {
+ShareId Share::getShareId() const {
     return shareId;
 }
 
-const std::vector<uint32_t>& Share::getPrevRefs() const {
+const std::vector<ShareId>& Share::getPrevRefs() const {
     return prevShares;
 }
-ns3::Time Share::getTimestamp() const{
+ShareTime Share::getTimestamp() const{
     return timestamp;
 }
 
-void Share::addPrevRef(uint32_t shareid) {
+void Share::addPrevRef(ShareId shareid) {
         prevShares.push_back(shareid);
 }
 
-uint32_t Share::getParentId() const {
+ShareId Share::getParentId() const {
   return parentId;
-}
\ No newline at end of file
+}
+
+double Share::getDifficulty() const {
+  return difficulty;
+}
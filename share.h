@@ -4,7 +4,13 @@
 #include <vector>
 #include <ctime>
 #include <cstdint>
-#include "ns3/simulator.h"
+#include "sharetime.h"
+
+/**
+ * Share identifier. Mined shares use ((creator node ID + 1) << 32) | sequence,
+ * which cannot collide; genesis is 1 and 0 means "no share".
+ */
+using ShareId = uint64_t;
 
 /**
  * Class to represent a Share in the P2Pool network
@@ -16,14 +22,16 @@ public:
      * @param senderId 
      * @param timestamp 
      * @param prevShares 
+     * @param difficulty work the share represents (1 = base difficulty)
      */
-    Share(uint64_t shareId, uint32_t senderId, ns3::Time timestamp, 
-          const std::vector<uint32_t>& prevShares,uint32_t parentId);
+    Share(ShareId shareId, uint32_t senderId, ShareTime timestamp, 
+          const std::vector<ShareId>& prevShares, ShareId parentId,
+          double difficulty = 1.0);
 
     /**
      * Returns the unique ID of the share.
      */
-    uint32_t getShareId() const;
+    ShareId getShareId() const;
 
     /**
      * Returns the ID of the sender (node who created this share).
@@ -33,17 +41,17 @@ public:
     /**
      * Returns the timestamp of when this share was created.
      */
-    ns3::Time getTimestamp() const;
+    ShareTime getTimestamp() const;
 
     /**
      * Returns the vector of previous shares (i.e., references to other shares).
      */
-    const std::vector<uint32_t>& getPrevRefs() const;
+    const std::vector<ShareId>& getPrevRefs() const;
 
     /**
      * Add a reference to previous shares. (Placeholder: implementation not shown here)
      */
-    void addPrevRef(uint32_t shareid) ;
+    void addPrevRef(ShareId shareid) ;
 
     /**
      * Less-than comparison operator based on timestamp.
@@ -55,14 +63,20 @@ public:
     /**
      * Get ParentId which this share connects as part of mainchain.
      */
-    uint32_t getParentId() const;
+    ShareId getParentId() const;
+
+    /**
+     * Get the difficulty the share was mined at.
+     */
+    double getDifficulty() const;
     
 private:
-    uint32_t shareId;                
+    ShareId shareId;                
     uint32_t senderId;               
-    ns3::Time timestamp;                
-    std::vector<uint32_t> prevShares;   
-    uint32_t parentId;
+    ShareTime timestamp;                
+    std::vector<ShareId> prevShares;   
+    ShareId parentId;
+    double difficulty;
 };
 
 #endif 
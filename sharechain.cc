@@ -1,61 +1,207 @@
 #include <iostream>
 #include "sharechain.h"
+#include "profiler.h"
+#include "chainlog.h"
 #include <algorithm>
 #include <queue>
-#include "ns3/simulator.h"
-#include "ns3/log.h"
-#include <boost/graph/graphviz.hpp>
 #include <unordered_set>
 #include <limits>
-#include <filesystem> 
-namespace fs = std::filesystem;
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-NS_LOG_COMPONENT_DEFINE("ShareChain");
+namespace {
+// Snapshot layout (host byte order, every section naturally aligned):
+//   SnapshotHeader | SnapshotVertex[vertexCount] | uint32 ref[refCount] | SnapshotTip[tipCount]
+// Vertices are in insertion order with genesis first; references are
+// stored as vertex indices, which are always smaller than the referrer's.
+const char kSnapshotMagic[8] = {'P', '2', 'P', 'S', 'N', 'A', 'P', '3'};
 
-ShareChain::ShareChain(ns3::Time max_time) 
-    : totalShares(0), genesisShare(nullptr), max_share_timestamp(max_time) {
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t vertexCount;
+    uint32_t tipCount;
+    uint64_t refCount;
+    uint64_t bestTip;
+    int64_t latestTimestamp;
+    uint32_t bestTipWeight;
+    uint32_t reserved;
+};
+
+struct SnapshotVertex {
+    int64_t timestamp;
+    double difficulty;
+    double chainWork;
+    uint64_t fingerprint;
+    uint64_t firstRef;
+    uint64_t shareId;
+    uint64_t parentId;
+    uint32_t senderId;
+    uint32_t height;
+    uint32_t uncleCount;
+    uint32_t refCount;
+};
+
+struct SnapshotTip {
+    uint32_t vertex;
+    uint32_t weight;
+};
+
+// splitmix64 finalizer
+uint64_t mixFingerprint(uint64_t parent, ShareId shareId) {
+    uint64_t x = parent + 0x9e3779b97f4a7c15ULL * (shareId + 1);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static_assert(sizeof(SnapshotHeader) % 8 == 0 && sizeof(SnapshotVertex) % 8 == 0,
+              "snapshot sections must stay 8-byte aligned");
+}
+
+ShareChain::ShareChain(ShareTime max_time) 
+    : genesisShare(nullptr), bestTip(1), bestTipWeight(1), retargetWindow(0), targetInterval(0),
+      payoutWindow(0), uncleWeight(0), payoutFrom(1), payoutTo(1), payoutTotal(0),
+      totalShares(0), max_share_timestamp(max_time) {
     createGenesisShare();
 }
 
 void ShareChain::createGenesisShare() {
-    genesisShare = new Share(1, 0, ns3::Seconds(0), std::vector<uint32_t>(), 0);
-    Vertex genesisVertex = boost::add_vertex({genesisShare}, graph);
+    genesisShare = new Share(1, 0, ShareTime(), std::vector<ShareId>(), 0);
+    Vertex genesisVertex = boost::add_vertex({genesisShare, 1, 0, genesisShare->getDifficulty(),
+                                                 mixFingerprint(0, genesisShare->getShareId())}, graph);
+    mainChain.push_back(genesisVertex);
     shareToVertex[1] = genesisVertex;
     ChainTips[genesisShare->getShareId()]=1;
     totalShares = 1;
 }
 
 bool ShareChain::addShare(Share* share) {
+    P2POOL_PROFILE_SCOPE("ShareChain::addShare");
+    if (!admitShare(share)) return false;
+
+    Vertex newVertex = connectShare(share);
+    ShareId previousBestTip = bestTip;
+    updateChainTips(share, newVertex);
+    if (listener.onConnected) listener.onConnected(share);
+    if (bestTip != previousBestTip && listener.onBestTipChanged) {
+        listener.onBestTipChanged(previousBestTip, bestTip);
+    }
+    processPendingShares();
+    
+    return true;
+}
+
+size_t ShareChain::addShares(const std::vector<Share*>& shares) {
+    P2POOL_PROFILE_SCOPE("ShareChain::addShares");
+    shareToVertex.reserve(shareToVertex.size() + shares.size());
+
+    std::vector<Vertex> added;
+    added.reserve(shares.size());
+    auto connect = [&](Share* share) {
+        Vertex v = connectShare(share);
+        for (ShareId prevId : share->getPrevRefs()) {
+            ChainTips.erase(prevId);
+        }
+        ChainTips[share->getShareId()] = 0;
+        added.push_back(v);
+        if (listener.onConnected) listener.onConnected(share);
+    };
+    for (Share* share : shares) {
+        if (admitShare(share)) connect(share);
+    }
+
+    // Release parked shares in waves: every wave connects all shares whose
+    // references are complete, which may complete the next wave's.
+    std::vector<Share*> ready;
+    while (!pendingShares.empty()) {
+        ready.clear();
+        for (const auto& pending : pendingShares) {
+            if (validatePrevRefs(pending.second)) ready.push_back(pending.second);
+        }
+        if (ready.empty()) break;
+        for (Share* share : ready) {
+            pendingShares.erase(share->getShareId());
+            if (shareToVertex.find(share->getShareId()) == shareToVertex.end()) connect(share);
+        }
+    }
+
+    // Only the shares that are still tips need a weight. Any other share of
+    // the batch is outweighed by a tip descending from it, so the best tip
+    // is the heaviest of these, the earliest connected one on a tie, just as
+    // if the shares had been added one by one.
+    ShareId previousBestTip = bestTip;
+    Vertex best = boost::graph_traits<ShareGraph>::null_vertex();
+    for (Vertex v : added) {
+        auto tip = ChainTips.find(graph[v].share->getShareId());
+        if (tip == ChainTips.end()) continue;
+        tip->second = calculateSubtreeWeight(v);
+        if (tip->second > bestTipWeight) {
+            bestTip = tip->first;
+            bestTipWeight = tip->second;
+            best = v;
+        }
+    }
+    if (best != boost::graph_traits<ShareGraph>::null_vertex()) {
+        updateMainChain(best);
+    }
+    if (bestTip != previousBestTip && listener.onBestTipChanged) {
+        listener.onBestTipChanged(previousBestTip, bestTip);
+    }
+    return added.size();
+}
+
+bool ShareChain::admitShare(Share* share) {
     if (!share) return false;
     if(max_share_timestamp < share->getTimestamp() ) {
+        CHAIN_LOG(ChainLogLevel::Debug, "rejecting share " << share->getShareId() << " with timestamp "
+                                        << share->getTimestamp() << " beyond " << max_share_timestamp);
         return false;
     }
-    uint32_t shareId = share->getShareId();
+    ShareId shareId = share->getShareId();
     if (shareToVertex.find(shareId) != shareToVertex.end()) return false; 
     
     if (!validatePrevRefs(share)) {
+        if (pendingShares.find(shareId) == pendingShares.end()) {
+            CHAIN_LOG(ChainLogLevel::Debug, "share " << shareId << " parked until its references arrive");
+            if (listener.onPending) listener.onPending(share);
+        }
         pendingShares[shareId] = share;
         return false;
     }
-    
+    return true;
+}
+
+ShareChain::Vertex ShareChain::connectShare(Share* share) {
     totalShares++;
-    Vertex newVertex = boost::add_vertex({share}, graph);
-    shareToVertex[shareId] = newVertex;
-    for (uint32_t prevId : share->getPrevRefs()) {
+    const VertexProperties& parent = graph[shareToVertex[share->getParentId()]];
+    uint32_t height = parent.height + 1;
+    uint32_t uncleCount = parent.uncleCount;
+    if (!share->getPrevRefs().empty()) {
+        uncleCount += share->getPrevRefs().size() - 1;
+    }
+    double chainWork = parent.chainWork + share->getDifficulty();
+    uint64_t fingerprint = mixFingerprint(parent.fingerprint, share->getShareId());
+    Vertex newVertex = boost::add_vertex({share, height, uncleCount, chainWork, fingerprint}, graph);
+    shareToVertex[share->getShareId()] = newVertex;
+    for (ShareId prevId : share->getPrevRefs()) {
             if (shareToVertex.find(prevId) != shareToVertex.end()) {
                 Vertex prevVertex = shareToVertex[prevId];
                 boost::add_edge(newVertex, prevVertex, graph);
             }
 
     }
+    return newVertex;
+}
 
-    updateChainTips(share, newVertex);
-    processPendingShares();
-    
-    return true;
+void ShareChain::setListener(Listener newListener) {
+    listener = std::move(newListener);
 }
 
-const std::unordered_map<uint32_t,uint32_t> ShareChain::getChainTips() const {
+const std::unordered_map<ShareId,uint32_t> ShareChain::getChainTips() const {
     return ChainTips;
 }
 
@@ -69,11 +215,11 @@ size_t ShareChain::getTotalShares() const {
     return totalShares;
 }
 
-void ShareChain::setmaxtimestamp(ns3::Time maxtime) {
+void ShareChain::setmaxtimestamp(ShareTime maxtime) {
      max_share_timestamp = maxtime;
 }
 
-const std::unordered_map<uint32_t, ShareChain::Vertex>& ShareChain::getAllShareVertices() const {
+const ShareIdMap<ShareChain::Vertex>& ShareChain::getAllShareVertices() const {
     return shareToVertex;
 }
 
@@ -82,6 +228,7 @@ Share* ShareChain::getGenesisShare() const {
 }
 
 uint32_t ShareChain::calculateSubtreeWeight(Vertex v) {
+    P2POOL_PROFILE_SCOPE("ShareChain::calculateSubtreeWeight");
     if (v == boost::graph_traits<ShareGraph>::null_vertex()) {
         return 0;
     }
@@ -109,58 +256,469 @@ uint32_t ShareChain::calculateSubtreeWeight(Vertex v) {
 }
 
 void ShareChain::updateChainTips(Share* share, Vertex vertex) {
-    int weight = calculateSubtreeWeight(vertex);
-    for (uint32_t prevId : share->getPrevRefs()) {
+    uint32_t weight = calculateSubtreeWeight(vertex);
+    for (ShareId prevId : share->getPrevRefs()) {
         if(ChainTips.find(prevId)!=ChainTips.end())
         ChainTips.erase(prevId);
     }
     ChainTips[share->getShareId()] = weight;
+    // A share outweighs every tip it references, so replacing the best tip
+    // only ever needs a comparison with the current one.
+    if (weight > bestTipWeight) {
+        bestTip = share->getShareId();
+        bestTipWeight = weight;
+        updateMainChain(vertex);
+    }
 }
 
 bool ShareChain::validatePrevRefs(const Share* share) const {
     if (!share) return false;
 
-    for (uint32_t prevId : share->getPrevRefs()) {
+    for (ShareId prevId : share->getPrevRefs()) {
             if (shareToVertex.find(prevId) == shareToVertex.end()) {
                 return false; 
             }
     }
-    
+    // the parent has to be known as well to place the share on a chain
+    return shareToVertex.find(share->getParentId()) != shareToVertex.end();
+}
+
+ShareId ShareChain::getBestTip() const {
+    return bestTip;
+}
+
+void ShareChain::updateMainChain(Vertex tip) {
+    std::vector<Vertex> branch;
+    Vertex v = tip;
+    // walk down until reaching a share that is already on the main chain
+    while (graph[v].height > mainChain.size() || mainChain[graph[v].height - 1] != v) {
+        branch.push_back(v);
+        v = shareToVertex[graph[v].share->getParentId()];
+    }
+    size_t fork = graph[v].height;
+    if (payoutTo > fork) {
+        // take the replaced shares out of the payout window first
+        for (size_t i = std::max(payoutFrom, fork); i < payoutTo; ++i) {
+            creditPayout(i, -1);
+        }
+        payoutFrom = std::min(payoutFrom, fork);
+        payoutTo = fork;
+    }
+    mainChain.resize(fork);
+    mainChain.insert(mainChain.end(), branch.rbegin(), branch.rend());
+    slidePayoutWindow();
+}
+
+bool ShareChain::saveSnapshot(const std::string& path) const {
+    P2POOL_PROFILE_SCOPE("ShareChain::saveSnapshot");
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+
+    size_t count = boost::num_vertices(graph);
+    std::vector<SnapshotVertex> vertices(count);
+    std::vector<uint32_t> refs;
+    for (Vertex v = 0; v < count; ++v) {
+        const VertexProperties& props = graph[v];
+        SnapshotVertex& record = vertices[v];
+        record.timestamp = props.share->getTimestamp().GetNanoSeconds();
+        record.difficulty = props.share->getDifficulty();
+        record.chainWork = props.chainWork;
+        record.fingerprint = props.fingerprint;
+        record.firstRef = refs.size();
+        record.shareId = props.share->getShareId();
+        record.senderId = props.share->getSenderId();
+        record.parentId = props.share->getParentId();
+        record.height = props.height;
+        record.uncleCount = props.uncleCount;
+        record.refCount = props.share->getPrevRefs().size();
+        for (ShareId ref : props.share->getPrevRefs()) {
+            refs.push_back(shareToVertex.at(ref));
+        }
+    }
+    std::vector<SnapshotTip> tips;
+    for (const auto& tip : ChainTips) {
+        tips.push_back({static_cast<uint32_t>(shareToVertex.at(tip.first)), tip.second});
+    }
+    // deterministic files for identical chains
+    std::sort(tips.begin(), tips.end(),
+              [](const SnapshotTip& a, const SnapshotTip& b) { return a.vertex < b.vertex; });
+
+    SnapshotHeader header;
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.vertexCount = count;
+    header.tipCount = tips.size();
+    header.refCount = refs.size();
+    header.bestTip = bestTip;
+    header.bestTipWeight = bestTipWeight;
+    header.reserved = 0;
+    header.latestTimestamp = getLatestTimestamp().GetNanoSeconds();
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(vertices.data()), vertices.size() * sizeof(SnapshotVertex));
+    out.write(reinterpret_cast<const char*>(refs.data()), refs.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(tips.data()), tips.size() * sizeof(SnapshotTip));
+    return static_cast<bool>(out);
+}
+
+bool ShareChain::loadSnapshot(const std::string& path, ShareTime shift) {
+    P2POOL_PROFILE_SCOPE("ShareChain::loadSnapshot");
+    if (boost::num_vertices(graph) != 1 || !pendingShares.empty()) return false;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    const char* base = static_cast<const char*>(mapped);
+    const SnapshotHeader* header = reinterpret_cast<const SnapshotHeader*>(base);
+    auto reject = [&]() {
+        shareToVertex = ShareIdMap<Vertex>();
+        shareToVertex[genesisShare->getShareId()] = 0;
+        ::munmap(mapped, size);
+        return false;
+    };
+    if (std::memcmp(header->magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) return reject();
+    // section sizes checked one at a time, so hostile counts cannot overflow
+    size_t remaining = size - sizeof(SnapshotHeader);
+    if (header->vertexCount == 0 || header->vertexCount > remaining / sizeof(SnapshotVertex)) {
+        return reject();
+    }
+    remaining -= size_t(header->vertexCount) * sizeof(SnapshotVertex);
+    if (header->refCount > remaining / sizeof(uint32_t)) return reject();
+    remaining -= header->refCount * sizeof(uint32_t);
+    if (header->tipCount > remaining / sizeof(SnapshotTip)) return reject();
+    remaining -= size_t(header->tipCount) * sizeof(SnapshotTip);
+    const SnapshotVertex* vertices = reinterpret_cast<const SnapshotVertex*>(base + sizeof(SnapshotHeader));
+    if (remaining != 0 || vertices[0].shareId != genesisShare->getShareId()) return reject();
+    const uint32_t* refs = reinterpret_cast<const uint32_t*>(vertices + header->vertexCount);
+    const SnapshotTip* tips = reinterpret_cast<const SnapshotTip*>(refs + header->refCount);
+
+    // Validate every record before the graph is touched: references point
+    // back into the file, IDs are unique, and each share sits one above its
+    // parent. Vertex i will be graph vertex i, so the index is built here.
+    shareToVertex.reserve(header->vertexCount);
+    for (uint32_t i = 1; i < header->vertexCount; ++i) {
+        const SnapshotVertex& record = vertices[i];
+        if (record.firstRef > header->refCount || record.refCount > header->refCount - record.firstRef) {
+            return reject();
+        }
+        for (uint64_t r = record.firstRef; r < record.firstRef + record.refCount; ++r) {
+            if (refs[r] >= i) return reject();
+        }
+        auto parent = shareToVertex.find(record.parentId);
+        if (parent == shareToVertex.end()) return reject();
+        uint32_t parentHeight = parent->second == 0 ? 1 : vertices[parent->second].height;
+        if (record.height != parentHeight + 1) return reject();
+        // 0 is the index's empty-slot marker
+        if (record.shareId == 0 || shareToVertex.count(record.shareId)) return reject();
+        shareToVertex[record.shareId] = i;
+    }
+    for (uint32_t t = 0; t < header->tipCount; ++t) {
+        if (tips[t].vertex >= header->vertexCount) return reject();
+    }
+    if (shareToVertex.find(header->bestTip) == shareToVertex.end()) return reject();
+
+    // sized up front, then swapped in; vertex 0 is our own genesis
+    ShareGraph loaded(header->vertexCount);
+    loaded[0] = graph[0];
+    std::vector<ShareId> prevRefs;
+    for (uint32_t i = 1; i < header->vertexCount; ++i) {
+        const SnapshotVertex& record = vertices[i];
+        prevRefs.clear();
+        for (uint64_t r = record.firstRef; r < record.firstRef + record.refCount; ++r) {
+            prevRefs.push_back(vertices[refs[r]].shareId);
+        }
+        Share* share = new Share(record.shareId, record.senderId,
+                                 ShareTime::FromNanoSeconds(record.timestamp) + shift, prevRefs,
+                                 record.parentId, record.difficulty);
+        loaded[i] = {share, record.height, record.uncleCount, record.chainWork, record.fingerprint};
+        for (uint64_t r = record.firstRef; r < record.firstRef + record.refCount; ++r) {
+            boost::add_edge(i, refs[r], loaded);
+        }
+    }
+    graph.swap(loaded);
+    totalShares = header->vertexCount;
+
+    ChainTips.clear();
+    for (uint32_t t = 0; t < header->tipCount; ++t) {
+        ChainTips[vertices[tips[t].vertex].shareId] = tips[t].weight;
+    }
+    bestTip = header->bestTip;
+    bestTipWeight = header->bestTipWeight;
+    ::munmap(mapped, size);
+
+    updateMainChain(shareToVertex.at(bestTip));
+    CHAIN_LOG(ChainLogLevel::Info, "loaded snapshot " << path << " with " << totalShares
+                                   << " shares, best tip " << bestTip);
     return true;
 }
 
-uint32_t ShareChain::getBestTip() {
-    uint32_t max_weight=0;
-    uint32_t chosen_tip=0;
-    for(std::pair<uint32_t,uint32_t> i : ChainTips) {
-        if(max_weight < i.second) {
-            max_weight=i.second;
-            chosen_tip = i.first;
+bool ShareChain::readSnapshotLatestTimestamp(const std::string& path, ShareTime& latest) {
+    std::ifstream in(path, std::ios::binary);
+    SnapshotHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) {
+        return false;
+    }
+    latest = ShareTime::FromNanoSeconds(header.latestTimestamp);
+    return true;
+}
+
+ShareTime ShareChain::getLatestTimestamp() const {
+    ShareTime latest;
+    for (Vertex v = 0; v < boost::num_vertices(graph); ++v) {
+        latest = std::max(latest, graph[v].share->getTimestamp());
+    }
+    return latest;
+}
+
+uint64_t ShareChain::getMainChainFingerprint(uint32_t height) const {
+    if (height == 0 || height > mainChain.size()) return 0;
+    return graph[mainChain[height - 1]].fingerprint;
+}
+
+bool ShareChain::isOnMainChain(ShareId shareId) const {
+    auto it = shareToVertex.find(shareId);
+    return it != shareToVertex.end() && isMainVertex(it->second);
+}
+
+uint32_t ShareChain::getShareHeight(ShareId shareId) const {
+    auto it = shareToVertex.find(shareId);
+    return it != shareToVertex.end() ? graph[it->second].height : 0;
+}
+
+bool ShareChain::isMainVertex(Vertex v) const {
+    uint32_t height = graph[v].height;
+    return height <= mainChain.size() && mainChain[height - 1] == v;
+}
+
+const char* ShareChain::getVertexStatus(Vertex v) const {
+    if (isMainVertex(v)) return "main";
+    for (auto edges = boost::in_edges(v, graph); edges.first != edges.second; ++edges.first) {
+        if (isMainVertex(boost::source(*edges.first, graph))) return "uncle";
+    }
+    return "orphan";
+}
+
+ShareChain::ExportWindow::ExportWindow()
+    : minHeight(0),
+      maxHeight(std::numeric_limits<uint32_t>::max()),
+      from(ShareTime::FromNanoSeconds(std::numeric_limits<int64_t>::min())),
+      to(ShareTime::FromNanoSeconds(std::numeric_limits<int64_t>::max())) {
+}
+
+bool ShareChain::exportDag(std::ostream& out, ExportFormat format, const ExportWindow& window) const {
+    P2POOL_PROFILE_SCOPE("ShareChain::exportDag");
+    auto inWindow = [&](Vertex v) {
+        const VertexProperties& props = graph[v];
+        ShareTime timestamp = props.share->getTimestamp();
+        return props.height >= window.minHeight && props.height <= window.maxHeight &&
+               timestamp >= window.from && timestamp <= window.to;
+    };
+
+    if (format == ExportFormat::Dot) {
+        out << "digraph sharechain {\n  rankdir=RL;\n  node [shape=box, style=filled];\n";
+    } else {
+        out << "id\tsender\ttimestamp_ns\theight\tstatus\tparent\trefs\n";
+    }
+    for (Vertex v = 0; v < boost::num_vertices(graph); ++v) {
+        if (!inWindow(v)) continue;
+        const Share* share = graph[v].share;
+        const char* status = getVertexStatus(v);
+        if (format == ExportFormat::Dot) {
+            const char* color = status[0] == 'm' ? "lightblue" : status[0] == 'u' ? "orange" : "gray";
+            out << "  s" << share->getShareId() << " [label=\"" << share->getShareId() << "\\nnode "
+                << share->getSenderId() << " h" << graph[v].height << "\", fillcolor=" << color
+                << ", status=" << status << ", time=" << share->getTimestamp().GetNanoSeconds() << "];\n";
+            for (ShareId ref : share->getPrevRefs()) {
+                if (!inWindow(shareToVertex.at(ref))) continue;
+                out << "  s" << share->getShareId() << " -> s" << ref;
+                if (ref != share->getParentId()) out << " [style=dashed]";
+                out << ";\n";
+            }
+        } else {
+            out << share->getShareId() << '\t' << share->getSenderId() << '\t'
+                << share->getTimestamp().GetNanoSeconds() << '\t' << graph[v].height << '\t' << status
+                << '\t' << share->getParentId() << '\t';
+            const std::vector<ShareId>& refs = share->getPrevRefs();
+            if (refs.empty()) out << '-';
+            for (size_t i = 0; i < refs.size(); ++i) {
+                out << (i ? "," : "") << refs[i];
+            }
+            out << '\n';
         }
     }
-    return chosen_tip;
+    if (format == ExportFormat::Dot) {
+        out << "}\n";
+    }
+    out.flush();
+    return static_cast<bool>(out);
 }
 
-uint32_t ShareChain::MainChainLength() {
-    uint32_t chosen_tip = getBestTip();
-    uint32_t chain_length=1;
-    Share* mainShare = graph[shareToVertex[chosen_tip]].share;
-    while(mainShare->getShareId()!=1){
-    uint32_t parentid = mainShare->getParentId();
-    chain_length +=1;
-    mainShare =  graph[shareToVertex[parentid]].share;
+std::vector<ShareId> ShareChain::getLocator() const {
+    std::vector<ShareId> locator;
+    size_t step = 1;
+    for (size_t i = mainChain.size() - 1; i > 0; i -= std::min(step, i)) {
+        locator.push_back(graph[mainChain[i]].share->getShareId());
+        if (locator.size() >= 10) step *= 2;
+    }
+    locator.push_back(genesisShare->getShareId());
+    return locator;
+}
+
+ShareId ShareChain::findForkPoint(const std::vector<ShareId>& locator) const {
+    for (ShareId shareId : locator) {
+        if (isOnMainChain(shareId)) return shareId;
+    }
+    return genesisShare->getShareId();
+}
+
+std::vector<ShareId> ShareChain::getMainChainAfter(ShareId shareId) const {
+    std::vector<ShareId> ids;
+    if (!isOnMainChain(shareId)) return ids;
+    for (size_t i = graph[shareToVertex.at(shareId)].height; i < mainChain.size(); ++i) {
+        ids.push_back(graph[mainChain[i]].share->getShareId());
     }
-    return chain_length;
+    return ids;
 }
 
-std::vector<uint32_t> ShareChain::showchain() {
-    std::vector<uint32_t> ans;
-    uint32_t chosen_tip = getBestTip();
+std::vector<const Share*> ShareChain::getSharesAfter(ShareId shareId) const {
+    std::vector<const Share*> shares;
+    auto it = shareToVertex.find(shareId);
+    if (it == shareToVertex.end()) return shares;
+    // vecS storage keeps vertices in insertion order
+    size_t count = boost::num_vertices(graph);
+    shares.reserve(count - it->second - 1);
+    for (Vertex v = it->second + 1; v < count; ++v) {
+        shares.push_back(graph[v].share);
+    }
+    return shares;
+}
+
+std::vector<const Share*> ShareChain::getSharesAbove(ShareId forkPoint) const {
+    std::vector<const Share*> shares;
+    auto it = shareToVertex.find(forkPoint);
+    if (it == shareToVertex.end()) return shares;
+    Vertex fork = it->second;
+    uint32_t forkHeight = graph[fork].height;
+    size_t count = boost::num_vertices(graph);
+    std::vector<bool> send(count, false);
+    // References precede their shares, so walking newest first marks every
+    // reference before it is reached. The main chain up to the fork is
+    // what the peer's locator already covers.
+    for (Vertex v = count; v-- > 0;) {
+        if (graph[v].height >= forkHeight && v != fork) send[v] = true;
+        if (!send[v]) continue;
+        for (ShareId ref : graph[v].share->getPrevRefs()) {
+            Vertex r = shareToVertex.at(ref);
+            if (!(graph[r].height <= forkHeight && isMainVertex(r))) send[r] = true;
+        }
+    }
+    for (Vertex v = 0; v < count; ++v) {
+        if (send[v]) shares.push_back(graph[v].share);
+    }
+    return shares;
+}
+
+void ShareChain::creditPayout(size_t index, double sign) {
+    const Share* share = graph[mainChain[index]].share;
+    double work = sign * share->getDifficulty();
+    payoutCredits[share->getSenderId()] += work;
+    payoutTotal += work;
+    if (uncleWeight <= 0) return;
+    for (ShareId ref : share->getPrevRefs()) {
+        if (ref == share->getParentId()) continue;
+        const Share* uncle = graph[shareToVertex[ref]].share;
+        double uncleWork = sign * uncleWeight * uncle->getDifficulty();
+        payoutCredits[uncle->getSenderId()] += uncleWork;
+        payoutTotal += uncleWork;
+    }
+}
+
+void ShareChain::slidePayoutWindow() {
+    if (payoutWindow == 0) return;
+    // index 0 is genesis, which pays nobody
+    size_t wantFrom = mainChain.size() > payoutWindow + 1 ? mainChain.size() - payoutWindow : 1;
+    while (payoutFrom > wantFrom) creditPayout(--payoutFrom, 1);
+    while (payoutTo < mainChain.size()) creditPayout(payoutTo++, 1);
+    while (payoutFrom < wantFrom) creditPayout(payoutFrom++, -1);
+}
+
+void ShareChain::setPayoutWindow(uint32_t window, double weight) {
+    payoutWindow = window;
+    uncleWeight = weight;
+    payoutCredits.clear();
+    payoutTotal = 0;
+    payoutFrom = payoutTo = mainChain.size();
+    slidePayoutWindow();
+}
+
+const std::unordered_map<uint32_t, double>& ShareChain::getPayoutCredits() const {
+    return payoutCredits;
+}
+
+double ShareChain::getPayoutTotal() const {
+    return payoutTotal;
+}
+
+void ShareChain::setRetargetWindow(uint32_t window, double interval) {
+    retargetWindow = window;
+    targetInterval = interval;
+}
+
+double ShareChain::getWindowInterval() const {
+    if (mainChain.size() < 2) return 0;
+    size_t last = mainChain.size() - 1;
+    size_t first = last > retargetWindow && retargetWindow > 0 ? last - retargetWindow : 0;
+    double span = (graph[mainChain[last]].share->getTimestamp() -
+                   graph[mainChain[first]].share->getTimestamp()).GetSeconds();
+    return span / (last - first);
+}
+
+double ShareChain::getNextShareDifficulty() const {
+    double tipDifficulty = graph[mainChain.back()].share->getDifficulty();
+    if (retargetWindow == 0 || mainChain.size() < 2) return tipDifficulty;
+
+    size_t last = mainChain.size() - 1;
+    size_t first = last > retargetWindow ? last - retargetWindow : 0;
+    double span = (graph[mainChain[last]].share->getTimestamp() -
+                   graph[mainChain[first]].share->getTimestamp()).GetSeconds();
+    double work = graph[mainChain[last]].chainWork - graph[mainChain[first]].chainWork;
+    if (span <= 0 || work <= 0) return tipDifficulty;
+
+    // work per second is the pool hash rate in units of base difficulty;
+    // limit each step to a factor of 4 like P2Pool does
+    double difficulty = work / span * targetInterval;
+    return std::min(std::max(difficulty, tipDifficulty / 4), tipDifficulty * 4);
+}
+
+size_t ShareChain::getTipCount() const {
+    return ChainTips.size();
+}
+
+size_t ShareChain::getPendingCount() const {
+    return pendingShares.size();
+}
+
+uint32_t ShareChain::MainChainLength() {
+    return graph[shareToVertex[bestTip]].height;
+}
+
+std::vector<ShareId> ShareChain::showchain() {
+    std::vector<ShareId> ans;
+    ShareId chosen_tip = getBestTip();
     uint32_t chain_length=1;
     Share* mainShare = graph[shareToVertex[chosen_tip]].share;
     while(mainShare->getShareId()!=1){
     ans.push_back(mainShare->getShareId());
-    uint32_t parentid = mainShare->getParentId();
+    ShareId parentid = mainShare->getParentId();
     chain_length +=1;
     mainShare =  graph[shareToVertex[parentid]].share;
     }
@@ -169,20 +727,13 @@ std::vector<uint32_t> ShareChain::showchain() {
 }
 
 uint32_t ShareChain::getUncleBlocks() {
-    uint32_t chosen_tip = getBestTip();
-    uint32_t UncleBlocks=0;
-    Share* mainShare = graph[shareToVertex[chosen_tip]].share;
-    while(mainShare->getShareId()!=1){
-    uint32_t parentid = mainShare->getParentId();
-    UncleBlocks +=(mainShare->getPrevRefs().size()-1);
-    mainShare =  graph[shareToVertex[parentid]].share;
-    }
-    return UncleBlocks;
+    return graph[shareToVertex[bestTip]].uncleCount;
 }
 
 void ShareChain::processPendingShares() {
+    P2POOL_PROFILE_SCOPE("ShareChain::processPendingShares");
     bool progress = true;
-    std::vector<uint32_t> processed;
+    std::vector<ShareId> processed;
     while (progress) {
         progress = false;
         processed.clear();
@@ -193,7 +744,7 @@ void ShareChain::processPendingShares() {
                 progress = true;
             }
         }
-        for (uint32_t id : processed) {
+        for (ShareId id : processed) {
             pendingShares.erase(id);
         }
     }
@@ -4,23 +4,38 @@
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/topological_sort.hpp>
+#include <functional>
+#include <ostream>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
 #include <memory>
+#include <string>
 #include <utility>
 #include "share.h"
-#include "ns3/simulator.h"
+#include "shareidmap.h"
+#include "sharetime.h"
 
 
 /**
  * Class to represent the ShareChain in the P2Pool network
  * Uses Boost Graph Library to maintain the DAG of shares
+ * Independent of ns-3: times are ShareTime and logging goes through the
+ * hook in chainlog.h
  */
 class ShareChain {
 public:
     struct VertexProperties {
         Share* share;
+        // Position on the chain of parents, genesis is height 1
+        uint32_t height;
+        // Uncle references along the chain of parents down to genesis
+        uint32_t uncleCount;
+        // Sum of share difficulties along the chain of parents
+        double chainWork;
+        // Rolling hash of the share IDs along the chain of parents, so two
+        // chains agree up to a height iff their fingerprints there match
+        uint64_t fingerprint;
     };
 
     using ShareGraph = boost::adjacency_list<
@@ -34,22 +49,75 @@ public:
     using Vertex = boost::graph_traits<ShareGraph>::vertex_descriptor;
     using Edge = boost::graph_traits<ShareGraph>::edge_descriptor;
 
+    /**
+     * Callbacks fired while shares are added; any of them may be left empty.
+     */
+    struct Listener {
+        // A share was parked because a reference is still missing
+        std::function<void(const Share*)> onPending;
+        // A share was connected to the DAG
+        std::function<void(const Share*)> onConnected;
+        // The heaviest tip changed from the first to the second share ID
+        std::function<void(ShareId, ShareId)> onBestTipChanged;
+    };
+
+    /**
+     * Output formats of exportDag
+     */
+    enum class ExportFormat {
+        // Graphviz digraph; practical up to a few thousand shares
+        Dot,
+        // Tab-separated table with one row per share and its references
+        Table
+    };
+
+    /**
+     * Shares exported by exportDag: both the height and the time bounds
+     * are inclusive. References leaving the window are kept in Table
+     * output and dropped from Dot output.
+     */
+    struct ExportWindow {
+        // Everything
+        ExportWindow();
+
+        uint32_t minHeight;
+        uint32_t maxHeight;
+        ShareTime from;
+        ShareTime to;
+    };
+
     /**
      * Constructor to initialize a ShareChain with a genesis node
      */
-    ShareChain(ns3::Time max_time);
+    ShareChain(ShareTime max_time);
+
+    /**
+     * Sets the callbacks fired by addShare
+     */
+    void setListener(Listener newListener);
     /**
      * Adds a share to the chain
      * @param share Pointer to the share to be added
      * @return true if share was successfully added, false otherwise
      */
     bool addShare(Share* share);
+
+    /**
+     * Adds a batch of shares, ideally in topological order (references
+     * first). Validation and connection run per share, but tip weights and
+     * the best tip are computed once for the whole batch, and parked shares
+     * are released in one sweep at the end. Shares with references missing
+     * from both the chain and the batch are parked as with addShare.
+     * @param shares Shares to add; the chain takes ownership like addShare
+     * @return Number of shares connected, including released parked shares
+     */
+    size_t addShares(const std::vector<Share*>& shares);
     
     /**
      * Gets the current main chain tip(s)
      * @return Vector of pairs containing weight and share pointer of main chain tips
      */
-    const std::unordered_map<uint32_t,uint32_t> getChainTips() const;
+    const std::unordered_map<ShareId,uint32_t> getChainTips() const;
     
     /**
      * Gets the count of orphaned shares (shares not in the main chain)
@@ -66,7 +134,7 @@ public:
      * Gets all shares in the chain
      * @return Map of all shares indexed by their IDs
      */
-    const std::unordered_map<uint32_t, Vertex>& getAllShareVertices() const;
+    const ShareIdMap<Vertex>& getAllShareVertices() const;
     
     /**
      * Gets the genesis share
@@ -78,7 +146,7 @@ public:
      * Gets maxtimestamp
      * @return return maxtimestamp
      */
-    void setmaxtimestamp(ns3::Time maxtime) ;
+    void setmaxtimestamp(ShareTime maxtime) ;
 
     /**
      * Gets mainchain length
@@ -93,29 +161,195 @@ public:
     /**
      *Traverse through mainchain and returns shares of mainchain
     */
-    std::vector<uint32_t> showchain();
+    std::vector<ShareId> showchain();
+
+    /**
+     * Gets tip with heaviest Subtree
+     */
+    ShareId getBestTip() const;
+
+    /**
+     * Enables share difficulty retargeting.
+     * The difficulty of the next share is the pool hash rate measured over
+     * the last window main-chain shares times targetInterval.
+     * @param window number of main-chain shares to average over (0 disables)
+     * @param targetInterval wanted time between shares in seconds
+     */
+    void setRetargetWindow(uint32_t window, double targetInterval);
+
+    /**
+     * Gets the difficulty a share built on the best tip must have (O(1))
+     */
+    double getNextShareDifficulty() const;
+
+    /**
+     * Gets the mean time between main-chain shares over the retarget window
+     * in seconds, or 0 if the main chain is too short
+     */
+    double getWindowInterval() const;
+
+    /**
+     * Enables the PPLNS payout window: the last window main-chain shares
+     * credit their sender with their difficulty, and every uncle they
+     * reference credits its own sender with uncleWeight times its
+     * difficulty. The window follows the main chain incrementally.
+     * @param window number of main-chain shares paid (0 disables)
+     * @param uncleWeight fraction of a share's work an uncle earns
+     */
+    void setPayoutWindow(uint32_t window, double uncleWeight);
+
+    /**
+     * Gets the credited work per sender ID in the current payout window
+     */
+    const std::unordered_map<uint32_t, double>& getPayoutCredits() const;
+
+    /**
+     * Gets the total credited work in the current payout window
+     */
+    double getPayoutTotal() const;
+
+    /**
+     * Writes the connected DAG (shares, reference edges, tips with their
+     * weights and the cached per-vertex heights, uncle counts and work) to a
+     * binary snapshot. Records have a fixed layout, in insertion order, so
+     * loading needs no parsing. Pending shares are not saved.
+     * @return false if the file could not be written
+     */
+    bool saveSnapshot(const std::string& path) const;
+
+    /**
+     * Memory-maps a snapshot and loads it into this chain, which must still
+     * hold only genesis. Cached values are taken as stored, so no subtree
+     * weight is recomputed.
+     * @param shift added to every share timestamp (e.g. to end the
+     *        snapshot at time 0 of a new simulation)
+     * @return false if the file is missing, malformed or the chain not fresh
+     */
+    bool loadSnapshot(const std::string& path, ShareTime shift = ShareTime());
+
+    /**
+     * Reads the newest share timestamp stored in a snapshot's header
+     * @return false if the file is missing or not a snapshot
+     */
+    static bool readSnapshotLatestTimestamp(const std::string& path, ShareTime& latest);
+
+    /**
+     * Streams the connected DAG to out, one share at a time in insertion
+     * order, without building an intermediate copy. Every share is labelled
+     * main (on the main chain), uncle (referenced by a main-chain share) or
+     * orphan, with its sender, timestamp and height.
+     * @return false if writing failed
+     */
+    bool exportDag(std::ostream& out, ExportFormat format,
+                   const ExportWindow& window = ExportWindow()) const;
+
+    /**
+     * Gets the newest timestamp of any connected share
+     */
+    ShareTime getLatestTimestamp() const;
+
+    /**
+     * Gets the rolling fingerprint of the main chain up to a height (O(1)),
+     * or 0 if the main chain is shorter. Two chains with equal fingerprints
+     * at a height hold the same main-chain shares up to that height.
+     */
+    uint64_t getMainChainFingerprint(uint32_t height) const;
+
+    /**
+     * Tells whether a share is on the current main chain (O(1))
+     */
+    bool isOnMainChain(ShareId shareId) const;
+
+    /**
+     * Gets a connected share's height on its chain of parents (genesis is
+     * 1), or 0 if the share is not connected (O(1))
+     */
+    uint32_t getShareHeight(ShareId shareId) const;
+
+    /**
+     * Builds a sync locator: main-chain share IDs from the best tip back to
+     * genesis, dense for the last ten shares and exponentially sparser after
+     */
+    std::vector<ShareId> getLocator() const;
+
+    /**
+     * Gets the first share of a peer's locator that is on our main chain,
+     * i.e. the point our main chain forked from the peer's (genesis if none)
+     */
+    ShareId findForkPoint(const std::vector<ShareId>& locator) const;
+
+    /**
+     * Gets the main-chain share IDs above the given main-chain share
+     */
+    std::vector<ShareId> getMainChainAfter(ShareId shareId) const;
+
+    /**
+     * Gets the shares connected after the given share, in insertion order.
+     * Insertion order is topological: every share follows its references.
+     */
+    std::vector<const Share*> getSharesAfter(ShareId shareId) const;
+
+    /**
+     * Gets the shares a peer whose main chain contains forkPoint may lack:
+     * every share at or above the fork's height but the fork itself, and the
+     * side-branch shares those reference below it, however early they were
+     * inserted. Returned in insertion order (topological).
+     */
+    std::vector<const Share*> getSharesAbove(ShareId forkPoint) const;
+
+    /**
+     * Gets the number of current chain tips
+     */
+    size_t getTipCount() const;
+
+    /**
+     * Gets the number of shares waiting for missing references
+     */
+    size_t getPendingCount() const;
 
 private:
     // The graph that stores our DAG of shares
     ShareGraph graph;
     
     // Maps share IDs to their vertices in the graph
-    std::unordered_map<uint32_t, Vertex> shareToVertex;
+    ShareIdMap<Vertex> shareToVertex;
     
     // Current tipsID of the sharechain with their weights 
-    std::unordered_map<uint32_t,uint32_t>  ChainTips;
+    std::unordered_map<ShareId,uint32_t>  ChainTips;
     
     // Pending shares that couldn't be added due to missing previous references
-    std::unordered_map<uint32_t, Share*> pendingShares;
+    std::unordered_map<ShareId, Share*> pendingShares;
     
     // Genesis share
     Share* genesisShare;
+
+    // Event callbacks
+    Listener listener;
+
+    // Heaviest tip and its weight; ties keep the tip that arrived first
+    ShareId bestTip;
+    uint32_t bestTipWeight;
+
+    // Vertices of the main chain indexed by height - 1 (genesis first)
+    std::vector<Vertex> mainChain;
+
+    // Difficulty retargeting parameters (window 0 = fixed difficulty)
+    uint32_t retargetWindow;
+    double targetInterval;
+
+    // PPLNS window over mainChain[payoutFrom, payoutTo) and its credits
+    uint32_t payoutWindow;
+    double uncleWeight;
+    size_t payoutFrom;
+    size_t payoutTo;
+    double payoutTotal;
+    std::unordered_map<uint32_t, double> payoutCredits;
     
     // Total number of shares in the chain
     size_t totalShares;
     
     //share's maxiumum timestamp limit
-    ns3::Time max_share_timestamp;
+    ShareTime max_share_timestamp;
     
     /**
      * Calculates the weight of a subtree (number of nodes from this share to genesis)
@@ -130,6 +364,44 @@ private:
      * @param vertex Vertex of the newly added share
      */
     void updateChainTips(Share* share, Vertex vertex);
+    /**
+     * Makes mainChain end at the given tip. Extending the chain by one share
+     * is O(1); a reorganisation costs the number of replaced shares.
+     */
+    void updateMainChain(Vertex tip);
+
+    /**
+     * Tells whether a vertex is on the current main chain (O(1))
+     */
+    bool isMainVertex(Vertex v) const;
+
+    /**
+     * Gets "main", "uncle" or "orphan" for exportDag
+     */
+    const char* getVertexStatus(Vertex v) const;
+
+    /**
+     * Adds (sign 1) or removes (sign -1) the payout credits of mainChain[index]
+     */
+    void creditPayout(size_t index, double sign);
+
+    /**
+     * Moves the payout window to the last payoutWindow main-chain shares,
+     * touching only the shares that enter or leave it
+     */
+    void slidePayoutWindow();
+
+    /**
+     * Checks timestamp and duplicates and parks shares with missing
+     * references. Returns true if the share can be connected now.
+     */
+    bool admitShare(Share* share);
+
+    /**
+     * Adds the vertex and reference edges of an admitted share
+     */
+    Vertex connectShare(Share* share);
+
     /**
      * Validates that all previous shares referenced by a share exist in the graph
      * @param share Share to validate
@@ -147,12 +419,6 @@ private:
      */
     void createGenesisShare();
 
-    /**
-     * Gets tip with heaviest Subtree
-     */
-    uint32_t getBestTip();
-
-
 };
 
 #endif 
\ No newline at end of file
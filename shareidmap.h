@@ -0,0 +1,132 @@
+#ifndef SHAREIDMAP_H
+#define SHAREIDMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "share.h"
+
+/**
+ * Open-addressing hash map from share IDs to small values, used as the
+ * ShareChain's ID index. Entries live inline in one power-of-two array
+ * probed linearly, so a lookup usually touches a single cache line instead
+ * of chasing unordered_map node pointers. Entries are never erased.
+ *
+ * ID 0 is reserved as the empty-slot marker (it is the genesis share's
+ * parent and never a real share).
+ */
+template <typename Value>
+class ShareIdMap {
+public:
+    struct Entry {
+        ShareId first;
+        Value second;
+    };
+
+    class const_iterator {
+    public:
+        const_iterator(const Entry* slot, const Entry* end) : slot(slot), end(end) {
+            skipEmpty();
+        }
+        const Entry& operator*() const { return *slot; }
+        const Entry* operator->() const { return slot; }
+        const_iterator& operator++() {
+            ++slot;
+            skipEmpty();
+            return *this;
+        }
+        bool operator==(const const_iterator& other) const { return slot == other.slot; }
+        bool operator!=(const const_iterator& other) const { return slot != other.slot; }
+
+    private:
+        void skipEmpty() {
+            while (slot != end && slot->first == 0) ++slot;
+        }
+
+        const Entry* slot;
+        const Entry* end;
+    };
+
+    ShareIdMap() : entries(0), mask(0) {}
+
+    size_t size() const { return entries; }
+
+    const_iterator begin() const { return const_iterator(slots.data(), slots.data() + slots.size()); }
+    const_iterator end() const {
+        return const_iterator(slots.data() + slots.size(), slots.data() + slots.size());
+    }
+
+    /**
+     * Makes room for n entries without rehashing
+     */
+    void reserve(size_t n) {
+        size_t capacity = 16;
+        // keep the load factor at or below 1/2
+        while (capacity < 2 * n) capacity *= 2;
+        if (capacity > slots.size()) rehash(capacity);
+    }
+
+    const_iterator find(ShareId id) const {
+        const Entry* slot = lookup(id);
+        return slot ? const_iterator(slot, slots.data() + slots.size()) : end();
+    }
+
+    size_t count(ShareId id) const { return lookup(id) ? 1 : 0; }
+
+    const Value& at(ShareId id) const {
+        const Entry* slot = lookup(id);
+        if (!slot) throw std::out_of_range("unknown share ID");
+        return slot->second;
+    }
+
+    /**
+     * Gets the value of id, inserting a value-initialised one if missing
+     */
+    Value& operator[](ShareId id) {
+        if (2 * (entries + 1) > slots.size()) reserve(entries + 1);
+        size_t i = slotOf(id);
+        while (slots[i].first != 0) {
+            if (slots[i].first == id) return slots[i].second;
+            i = (i + 1) & mask;
+        }
+        slots[i].first = id;
+        slots[i].second = Value();
+        entries++;
+        return slots[i].second;
+    }
+
+private:
+    size_t slotOf(ShareId id) const {
+        // Fibonacci hashing spreads both node-prefixed and sequential IDs
+        return static_cast<size_t>((id * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+    }
+
+    const Entry* lookup(ShareId id) const {
+        if (entries == 0 || id == 0) return nullptr;
+        size_t i = slotOf(id);
+        while (slots[i].first != 0) {
+            if (slots[i].first == id) return &slots[i];
+            i = (i + 1) & mask;
+        }
+        return nullptr;
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Entry> old(capacity, Entry{0, Value()});
+        old.swap(slots);
+        mask = capacity - 1;
+        for (const Entry& entry : old) {
+            if (entry.first == 0) continue;
+            size_t i = slotOf(entry.first);
+            while (slots[i].first != 0) i = (i + 1) & mask;
+            slots[i] = entry;
+        }
+    }
+
+    std::vector<Entry> slots;
+    size_t entries;
+    size_t mask;
+};
+
+#endif
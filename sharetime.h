@@ -0,0 +1,52 @@
+#ifndef SHARETIME_H
+#define SHARETIME_H
+
+#include <cstdint>
+#include <ostream>
+
+/**
+ * Lightweight time value used by the share chain core.
+ * Stores signed nanoseconds, so it converts losslessly to and from ns3::Time
+ * without the chain engine depending on ns-3.
+ */
+class ShareTime {
+public:
+    ShareTime() : nanos(0) {}
+
+    static ShareTime FromNanoSeconds(int64_t nanos) {
+        return ShareTime(nanos);
+    }
+
+    static ShareTime FromSeconds(double seconds) {
+        return ShareTime(static_cast<int64_t>(seconds * 1e9));
+    }
+
+    int64_t GetNanoSeconds() const {
+        return nanos;
+    }
+
+    double GetSeconds() const {
+        return nanos / 1e9;
+    }
+
+    bool operator<(const ShareTime& other) const { return nanos < other.nanos; }
+    bool operator>(const ShareTime& other) const { return nanos > other.nanos; }
+    bool operator<=(const ShareTime& other) const { return nanos <= other.nanos; }
+    bool operator>=(const ShareTime& other) const { return nanos >= other.nanos; }
+    bool operator==(const ShareTime& other) const { return nanos == other.nanos; }
+    bool operator!=(const ShareTime& other) const { return nanos != other.nanos; }
+
+    ShareTime operator+(const ShareTime& other) const { return ShareTime(nanos + other.nanos); }
+    ShareTime operator-(const ShareTime& other) const { return ShareTime(nanos - other.nanos); }
+
+private:
+    explicit ShareTime(int64_t nanos) : nanos(nanos) {}
+
+    int64_t nanos;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const ShareTime& time) {
+    return os << time.GetSeconds() << "s";
+}
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * Offline replay of a P2Pool event log (--eventLog of the simulation).
+ *
+ * Feeds every node's recorded share arrivals, in their original order, into
+ * a fresh ShareChain and compares the final chain with the summary the
+ * simulation recorded. Nodes are independent, so they can be replayed on
+ * several threads.
+ *
+ * Usage: replay <log> [threads]
+ */
+
+#include "eventlog.h"
+#include "sharechain.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct NodeLog {
+    std::vector<std::string> arrivals;
+    bool hasSummary = false;
+    // arrival records that did not decode to a share
+    uint32_t malformed = 0;
+    ChainSummary expected;
+    ChainSummary replayed;
+};
+
+ChainSummary replayNode(NodeLog& log, ShareTime maxTimestamp) {
+    ShareChain chain(maxTimestamp);
+    for (const std::string& payload : log.arrivals) {
+        Share* share = decodeShare(payload);
+        if (!share) {
+            log.malformed++;
+            continue;
+        }
+        // like in the simulation, the chain keeps every share handed to it
+        chain.addShare(share);
+    }
+    ChainSummary summary;
+    summary.bestTip = chain.getBestTip();
+    summary.totalShares = chain.getTotalShares();
+    summary.mainChainLength = chain.MainChainLength();
+    summary.uncleBlocks = chain.getUncleBlocks();
+    summary.pendingShares = chain.getPendingCount();
+    return summary;
+}
+
+bool sameChain(const ChainSummary& a, const ChainSummary& b) {
+    return a.bestTip == b.bestTip && a.totalShares == b.totalShares &&
+           a.mainChainLength == b.mainChainLength && a.uncleBlocks == b.uncleBlocks &&
+           a.pendingShares == b.pendingShares;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <log> [threads]\n", argv[0]);
+        return 2;
+    }
+    unsigned threads = argc > 2 ? std::max(1, std::atoi(argv[2])) : 1;
+
+    EventLogReader reader(argv[1]);
+    if (!reader.isOpen()) {
+        std::fprintf(stderr, "%s is not a P2Pool event log\n", argv[1]);
+        return 2;
+    }
+    std::vector<NodeLog> nodes(reader.getNodeCount());
+    EventRecord record;
+    uint64_t arrivals = 0;
+    while (reader.next(record)) {
+        if (record.node >= nodes.size()) continue;
+        NodeLog& node = nodes[record.node];
+        if (record.type == EventType::Arrival) {
+            node.arrivals.push_back(std::move(record.payload));
+            arrivals++;
+        } else if (record.type == EventType::Summary) {
+            node.hasSummary = decodeSummary(record.payload, node.expected);
+        }
+    }
+
+    auto start = Clock::now();
+    std::atomic<size_t> nextNode(0);
+    auto worker = [&] {
+        for (size_t i = nextNode++; i < nodes.size(); i = nextNode++) {
+            nodes[i].replayed = replayNode(nodes[i], reader.getMaxTimestamp());
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (std::thread& thread : pool) thread.join();
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    std::printf("%-6s %9s %9s %9s %9s %20s %s\n", "node", "arrivals", "shares", "mainchain",
+                "uncles", "besttip", "check");
+    uint32_t mismatches = 0;
+    uint32_t corrupt = 0;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const NodeLog& node = nodes[i];
+        const char* check = "no summary";
+        if (node.malformed > 0) {
+            std::fprintf(stderr, "node %zu: skipped %u malformed arrival record(s)\n", i,
+                         node.malformed);
+            corrupt++;
+            check = "CORRUPT";
+        } else if (node.hasSummary) {
+            bool same = sameChain(node.expected, node.replayed);
+            mismatches += !same;
+            check = same ? "identical" : "MISMATCH";
+        }
+        std::printf("%-6zu %9zu %9u %9u %9u %20llu %s\n", i, node.arrivals.size(),
+                    node.replayed.totalShares, node.replayed.mainChainLength,
+                    node.replayed.uncleBlocks,
+                    static_cast<unsigned long long>(node.replayed.bestTip), check);
+    }
+    std::printf("replayed %llu arrivals on %u thread(s) in %.3fs (%.0f arrivals/s)\n",
+                static_cast<unsigned long long>(arrivals), threads, elapsed.count(),
+                arrivals / std::max(elapsed.count(), 1e-9));
+    if (corrupt > 0) {
+        std::printf("%u node(s) have malformed records\n", corrupt);
+    }
+    if (mismatches > 0) {
+        std::printf("%u node(s) differ from the recorded run\n", mismatches);
+    }
+    if (corrupt > 0 || mismatches > 0) return 1;
+    return 0;
+}
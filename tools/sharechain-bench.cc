@@ -0,0 +1,194 @@
+/**
+ * Standalone ShareChain microbenchmark.
+ *
+ * Feeds synthetic share DAGs straight into ShareChain::addShare, without any
+ * network simulation, and reports insertion and query costs. The same DAG is
+ * then inserted again through ShareChain::addShares in batches of 500, as a
+ * sync stream would be. Every workload uses a fixed seed, so numbers are
+ * comparable across commits.
+ *
+ * Usage: sharechain-bench [scale]
+ *   scale multiplies the number of shares of every workload (default 1.0)
+ */
+
+#include "share.h"
+#include "sharechain.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Workload {
+    std::string name;
+    std::string description;
+    uint64_t seed;
+    uint32_t shares;
+    std::function<std::vector<Share*>(uint32_t, std::mt19937_64&)> generate;
+};
+
+Share* makeShare(ShareId id, uint32_t sender, const std::vector<ShareId>& refs) {
+    // refs[0] is the parent, like the shares built by P2PoolNode
+    return new Share(id, sender, ShareTime::FromSeconds(id), refs, refs.front());
+}
+
+// Each share references the previous one.
+std::vector<Share*> linearChain(uint32_t count, std::mt19937_64& rng) {
+    std::vector<Share*> shares;
+    for (uint32_t i = 0; i < count; ++i) {
+        ShareId id = i + 2;
+        shares.push_back(makeShare(id, rng() % 64, {id - 1}));
+    }
+    return shares;
+}
+
+// Up to 64 concurrent branches: every share builds on one of the recent
+// shares and sometimes merges another tip, keeping many tips alive.
+std::vector<Share*> wideDag(uint32_t count, std::mt19937_64& rng) {
+    const uint32_t width = 64;
+    std::vector<Share*> shares;
+    for (uint32_t i = 0; i < count; ++i) {
+        ShareId id = i + 2;
+        uint32_t window = std::min<uint32_t>(i, width);
+        std::vector<ShareId> refs;
+        refs.push_back(window ? id - 1 - rng() % window : 1);
+        if (window > 1 && rng() % 4 == 0) {
+            ShareId other = id - 1 - rng() % window;
+            if (other != refs[0]) refs.push_back(other);
+        }
+        shares.push_back(makeShare(id, rng() % 64, refs));
+    }
+    return shares;
+}
+
+// The wide DAG delivered out of order: shares are shuffled inside blocks of
+// 256, so most of them wait in pendingShares for a missing reference.
+std::vector<Share*> outOfOrder(uint32_t count, std::mt19937_64& rng) {
+    std::vector<Share*> shares = wideDag(count, rng);
+    const size_t block = 256;
+    for (size_t start = 0; start < shares.size(); start += block) {
+        size_t end = std::min(shares.size(), start + block);
+        std::shuffle(shares.begin() + start, shares.begin() + end, rng);
+    }
+    return shares;
+}
+
+// Every share references its parent and up to 255 other recent shares.
+std::vector<Share*> largeRefs(uint32_t count, std::mt19937_64& rng) {
+    const uint32_t maxRefs = 256;
+    std::vector<Share*> shares;
+    for (uint32_t i = 0; i < count; ++i) {
+        ShareId id = i + 2;
+        std::vector<ShareId> refs;
+        uint32_t available = std::min<uint32_t>(i, maxRefs);
+        for (uint32_t r = 0; r < available; ++r) {
+            refs.push_back(id - 1 - r);
+        }
+        if (refs.empty()) refs.push_back(1);
+        shares.push_back(makeShare(id, rng() % 64, refs));
+    }
+    return shares;
+}
+
+const size_t batchSize = 500;
+
+template <typename F>
+double nanosPerCall(F query, int repetitions) {
+    auto start = Clock::now();
+    for (int i = 0; i < repetitions; ++i) query();
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    return elapsed.count() / repetitions;
+}
+
+void runWorkload(const Workload& workload, double scale) {
+    std::mt19937_64 rng(workload.seed);
+    uint32_t count = std::max<uint32_t>(1, workload.shares * scale);
+    std::vector<Share*> shares = workload.generate(count, rng);
+
+    ShareChain chain(ShareTime::FromSeconds(1e9));
+    auto start = Clock::now();
+    for (Share* share : shares) {
+        chain.addShare(share);
+    }
+    std::chrono::duration<double, std::nano> insert = Clock::now() - start;
+
+    // same DAG again, fed in batches
+    std::mt19937_64 batchRng(workload.seed);
+    std::vector<Share*> batchShares = workload.generate(count, batchRng);
+    ShareChain batchChain(ShareTime::FromSeconds(1e9));
+    start = Clock::now();
+    for (size_t first = 0; first < batchShares.size(); first += batchSize) {
+        size_t last = std::min(batchShares.size(), first + batchSize);
+        batchChain.addShares(std::vector<Share*>(batchShares.begin() + first,
+                                                 batchShares.begin() + last));
+    }
+    std::chrono::duration<double, std::nano> batchInsert = Clock::now() - start;
+    if (batchChain.getBestTip() != chain.getBestTip() ||
+        batchChain.MainChainLength() != chain.MainChainLength() ||
+        batchChain.getTipCount() != chain.getTipCount()) {
+        std::fprintf(stderr, "%s: batch insert built a different chain\n", workload.name.c_str());
+        std::exit(1);
+    }
+
+    volatile size_t sink = 0;
+    double mainChain = nanosPerCall([&] { sink += chain.MainChainLength(); }, 20);
+    double uncles = nanosPerCall([&] { sink += chain.getUncleBlocks(); }, 20);
+    double orphans = nanosPerCall([&] { sink += chain.getOrphanCount(); }, 20);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::printf("%-12s %9u %9zu %12.0f %12.0f %14.0f %14.0f %14.0f %10.1f\n",
+                workload.name.c_str(), count, chain.getTotalShares(),
+                insert.count() / shares.size(), batchInsert.count() / batchShares.size(),
+                mainChain, uncles, orphans,
+                usage.ru_maxrss / 1024.0);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    double scale = argc > 1 ? std::atof(argv[1]) : 1.0;
+
+    std::vector<Workload> workloads = {
+        {"linear", "single chain, one reference per share", 1, 10000, linearChain},
+        {"wide", "up to 64 live branches", 2, 10000, wideDag},
+        {"outoforder", "wide DAG shuffled in blocks of 256", 3, 10000, outOfOrder},
+        {"largerefs", "256 references per share", 4, 5000, largeRefs},
+    };
+
+    std::printf("%-12s %9s %9s %12s %12s %14s %14s %14s %10s\n",
+                "workload", "shares", "inchain", "ns/insert", "ns/batched", "ns/mainchain",
+                "ns/uncles", "ns/orphans", "peakMB");
+    std::fflush(stdout);
+
+    // Each workload runs in its own process so that peak RSS is per workload.
+    for (const Workload& workload : workloads) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            runWorkload(workload, scale);
+            std::fflush(stdout);
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::fprintf(stderr, "workload %s failed\n", workload.name.c_str());
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+/**
+ * ShareChain regression checks, run by ctest.
+ *
+ * Each check builds small share DAGs (and snapshot files) by hand and exits
+ * non-zero with a message on the first expectation that does not hold.
+ *
+ * Usage: sharechain-test
+ */
+
+#include "share.h"
+#include "sharechain.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #condition " failed" \
+                      << std::endl;                                               \
+            std::exit(1);                                                         \
+        }                                                                         \
+    } while (0)
+
+Share* makeShare(ShareId id, const std::vector<ShareId>& refs) {
+    // refs[0] is the parent, like the shares built by P2PoolNode
+    return new Share(id, 0, ShareTime::FromSeconds(id), refs, refs.front());
+}
+
+Share* copyShare(const Share* share) {
+    return new Share(share->getShareId(), share->getSenderId(), share->getTimestamp(),
+                     share->getPrevRefs(), share->getParentId(), share->getDifficulty());
+}
+
+// An uncle the server connected before the fork point, and that the
+// requester never saw, must still be served once a share above the fork
+// references it; otherwise that share stays parked on the requester.
+void syncServesEarlyUncle() {
+    ShareChain server(ShareTime::FromSeconds(1e9));
+    ShareChain requester(ShareTime::FromSeconds(1e9));
+
+    // server: genesis <- 2 <- 4, uncle 3 on genesis inserted before 4
+    server.addShare(makeShare(2, {1}));
+    server.addShare(makeShare(3, {1}));
+    server.addShare(makeShare(4, {2}));
+    requester.addShare(makeShare(2, {1}));
+    requester.addShare(makeShare(4, {2}));
+    // 5 extends the main chain and pays the uncle
+    server.addShare(makeShare(5, {4, 3}));
+
+    ShareId fork = server.findForkPoint(requester.getLocator());
+    CHECK(fork == 4);
+    std::vector<const Share*> shares = server.getSharesAbove(fork);
+    CHECK(shares.size() == 2);
+    CHECK(shares[0]->getShareId() == 3);
+    CHECK(shares[1]->getShareId() == 5);
+
+    std::vector<Share*> batch;
+    for (const Share* share : shares) {
+        batch.push_back(copyShare(share));
+    }
+    requester.addShares(batch);
+    CHECK(requester.getPendingCount() == 0);
+    CHECK(requester.getBestTip() == 5);
+    CHECK(requester.isOnMainChain(5));
+}
+
+// Main-chain shares at or below the fork are covered by the locator, and
+// side branches above it are served whole.
+void syncSkipsCoveredShares() {
+    ShareChain server(ShareTime::FromSeconds(1e9));
+    server.addShare(makeShare(2, {1}));
+    server.addShare(makeShare(3, {2}));
+    server.addShare(makeShare(4, {3}));
+    server.addShare(makeShare(5, {3}));
+    server.addShare(makeShare(6, {4}));
+
+    std::vector<const Share*> shares = server.getSharesAbove(3);
+    CHECK(shares.size() == 3);
+    CHECK(shares[0]->getShareId() == 4);
+    CHECK(shares[1]->getShareId() == 5);
+    CHECK(shares[2]->getShareId() == 6);
+    CHECK(server.getSharesAbove(6).empty());
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+bool loadsFrom(const std::string& path, const std::string& bytes) {
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+    ShareChain chain(ShareTime::FromSeconds(1e9));
+    return chain.loadSnapshot(path);
+}
+
+// A snapshot loads back whole, and out-of-range counts, references, tips or
+// a best tip that is not in the file make loadSnapshot return false.
+void snapshotRejectsCorruptRecords() {
+    // layout of the records in sharechain.cc
+    const size_t headerSize = 48;
+    const size_t vertexSize = 72;
+    const size_t refCountAt = 16;
+    const size_t bestTipAt = 24;
+    const size_t firstRefAt = 32;
+    const size_t vertexRefCountAt = 68;
+
+    ShareChain chain(ShareTime::FromSeconds(1e9));
+    chain.addShare(makeShare(2, {1}));
+    chain.addShare(makeShare(3, {1}));
+    chain.addShare(makeShare(4, {2, 3}));
+    std::string path = "sharechain-test.snapshot";
+    CHECK(chain.saveSnapshot(path));
+    const std::string good = readFile(path);
+    CHECK(loadsFrom(path, good));
+    ShareChain loaded(ShareTime::FromSeconds(1e9));
+    CHECK(loaded.loadSnapshot(path));
+    CHECK(loaded.getTotalShares() == 4);
+    CHECK(loaded.getBestTip() == 4);
+    CHECK(loaded.isOnMainChain(2) && !loaded.isOnMainChain(3));
+    CHECK(loaded.getUncleBlocks() == 1);
+
+    auto patch = [&](size_t offset, const void* value, size_t length) {
+        std::string bytes = good;
+        std::memcpy(&bytes[offset], value, length);
+        return bytes;
+    };
+    uint64_t huge = UINT64_MAX / 2;
+    uint32_t forward = 3;
+    uint32_t tooMany = 1000;
+    uint64_t unknown = 99;
+    const size_t refs = headerSize + 4 * vertexSize;
+    CHECK(!loadsFrom(path, good.substr(0, good.size() - 1)));
+    CHECK(!loadsFrom(path, patch(refCountAt, &huge, sizeof(huge))));
+    CHECK(!loadsFrom(path, patch(bestTipAt, &unknown, sizeof(unknown))));
+    // vertex 3 (share 4): a reference to itself, then a range past the refs
+    CHECK(!loadsFrom(path, patch(refs + 2 * sizeof(uint32_t), &forward, sizeof(forward))));
+    CHECK(!loadsFrom(path, patch(headerSize + 3 * vertexSize + vertexRefCountAt, &tooMany,
+                                 sizeof(tooMany))));
+    CHECK(!loadsFrom(path, patch(headerSize + 3 * vertexSize + firstRefAt, &huge, sizeof(huge))));
+    // the only tip points past the vertices
+    CHECK(!loadsFrom(path, patch(good.size() - 8, &tooMany, sizeof(tooMany))));
+    std::remove(path.c_str());
+}
+
+}
+
+int main() {
+    syncServesEarlyUncle();
+    syncSkipsCoveredShares();
+    snapshotRejectsCorruptRecords();
+    std::cout << "sharechain-test: all checks passed" << std::endl;
+    return 0;
+}